@@ -0,0 +1,99 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// this
+#include "clock_follow.h"
+#include "mode_common.h"
+
+void follow_init(follow_t *f) {
+  f->last = 0;
+  f->next = 0;
+  f->count = 0;
+  f->started = false;
+  f->target = 0;
+}
+
+// median of the held intervals, 0 if there are none
+u32 follow_period(follow_t *f) {
+  u32 sorted[FOLLOW_HISTORY];
+  u8 n = f->count;
+
+  for (u8 i = 0; i < n; i++) {
+    u32 v = f->interval[i];
+    u8 j = i;
+    for (; j > 0 && sorted[j - 1] > v; j--) {
+      sorted[j] = sorted[j - 1];
+    }
+    sorted[j] = v;
+  }
+
+  if (n == 0) {
+    return 0;
+  }
+  return sorted[n >> 1];
+}
+
+// records a pulse, returns the period or 0 while there isn't one yet
+static u32 follow_interval(follow_t *f, u32 time) {
+  u32 interval = time - f->last;
+  u32 period = follow_period(f);
+  f->last = time;
+
+  if (!f->started) {
+    f->started = true;
+    return 0;
+  }
+
+  if (period && (interval > period * FOLLOW_RESTART || interval * FOLLOW_RESTART < period)) {
+    // too far off to be jitter, start over from this interval
+    f->count = 0;
+    f->next = 0;
+  }
+
+  f->interval[f->next] = interval;
+  f->next = (f->next + 1) % FOLLOW_HISTORY;
+  if (f->count < FOLLOW_HISTORY) {
+    f->count++;
+  }
+  return follow_period(f);
+}
+
+static u16 follow_hz(u32 ticks, u32 period, u32 time_hz) {
+  u32 hz = ((u64)ticks * time_hz + (period >> 1)) / period;
+  return hz > 0xffff ? 0xffff : (hz == 0 ? 1 : hz);
+}
+
+// called for each pulse with its timestamp (in time_hz units) and the phasor
+// tick count at the time, the count is expected to be a multiple of PPQ at the
+// start of each step. returns the phasor frequency to run at until the next
+// pulse, or 0 while there isn't a period to follow yet.
+u16 follow_pulse(follow_t *f, u32 time, u16 tick, u16 ticks_per_pulse, u32 time_hz) {
+  u32 period = follow_interval(f, time);
+  if (period == 0) {
+    return 0;
+  }
+
+  // the first interval (or a restart) locks the pulse to the nearest step
+  // boundary, the error is steered out from there rather than jumped
+  s16 limit = ticks_per_pulse >> 1;
+  if (f->count == 1 || (s16)(f->target - tick) > limit || (s16)(f->target - tick) < -limit) {
+    f->target = (u16)(tick + (PPQ >> 1)) & ~(PPQ - 1);
+  }
+  s16 error = (s16)(f->target - tick);
+  f->target += ticks_per_pulse;
+
+  return follow_hz(ticks_per_pulse + (error >> 1), period, time_hz);
+}
+
+// as follow_pulse for callers which reset the phasor on each pulse, only the
+// rate is followed
+u16 follow_rate(follow_t *f, u32 time, u16 ticks_per_pulse, u32 time_hz) {
+  u32 period = follow_interval(f, time);
+  if (period == 0) {
+    return 0;
+  }
+  return follow_hz(ticks_per_pulse, period, time_hz);
+}
@@ -0,0 +1,40 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+// libavr32
+#include "compiler.h"
+#include "types.h"
+
+//
+// clock follower
+//
+// tracks an external clock from pulse timestamps. the pulse period is the
+// median of the last few intervals so jitter and the odd missed or extra
+// pulse are ignored. the phasor is steered toward the pulses by a first order
+// loop, each pulse the phase error (in phasor ticks) from the step boundary
+// it is locked to is measured and half of it is made up over the following
+// interval. the phasor only ever changes speed, it never jumps, so steps are
+// not dropped or doubled.
+//
+
+#define FOLLOW_HISTORY 5 // intervals the median is taken over
+#define FOLLOW_RESTART 4 // interval ratio treated as the clock stopping / starting
+
+typedef struct {
+  u32 last;                     // timestamp of the last pulse
+  u32 interval[FOLLOW_HISTORY]; // recent intervals, oldest is overwritten
+  u8 next;                      // slot for the next interval
+  u8 count;                     // intervals held
+  bool started;                 // a first pulse has been seen
+  u16 target;                   // phasor tick expected at the next pulse
+} follow_t;
+
+void follow_init(follow_t *f);
+u32 follow_period(follow_t *f);
+u16 follow_pulse(follow_t *f, u32 time, u16 tick, u16 ticks_per_pulse, u32 time_hz);
+u16 follow_rate(follow_t *f, u32 time, u16 ticks_per_pulse, u32 time_hz);
@@ -62,14 +62,23 @@ TARGET = $(THIS).elf
 # List of C source files.
 CSRCS = \
        ../src/main.c                                      \
+       ../src/clock_follow.c                              \
+       ../src/dispatch.c                                  \
+       ../src/event_ring.c                                \
        ../src/mode_grid.c                                 \
        ../src/mode_arc.c                                  \
        ../src/mode_midi.c                                 \
        ../src/mode_div.c                                  \
        ../src/mode_common.c                               \
+       ../src/period_table.c                              \
        ../src/gitversion.c                                \
+       ../src/knob.c                                      \
        ../src/meta.c                                      \
        ../src/playhead.c                                  \
+       ../src/profile.c                                   \
+       ../src/schedule.c                                  \
+       ../src/tap_tempo.c                                 \
+       ../src/timer_wheel.c                               \
        ../src/track.c                                     \
        ../libavr32/src/adc.c                              \
        ../libavr32/src/distort.c                          \
@@ -86,7 +95,6 @@ CSRCS = \
        ../libavr32/src/monome.c                           \
        ../libavr32/src/phasor.c                           \
        ../libavr32/src/random.c                           \
-       ../libavr32/src/timers.c                           \
        ../libavr32/src/usb.c                              \
        ../libavr32/src/util.c                             \
        ../libavr32/src/json/encoding.c                    \
@@ -213,6 +221,10 @@ CFLAGS =
 CPPFLAGS = \
       -D BOARD=USER_BOARD -D UHD_ENABLE
 
+# Uncomment to report cycle counts for the phasor and clock callbacks over the
+# debug uart, see profile.h
+# CPPFLAGS += -D TRANSIT_PROFILE
+
 # Extra flags to use when linking
 LDFLAGS = \
         -Wl,-e,_trampoline
@@ -223,5 +235,8 @@ POSTBUILD_CMD =
 
 transit: all
 
+../src/period_table.c: ../src/period_table.awk
+	awk -f $< > $@
+
 ../src/gitversion.c: ../.git/HEAD ../.git/index
 	echo 'const char git_version[] = "$(shell git describe --tags | cut -f1 -d'-')-$(shell git describe --always --dirty)";' > $@
@@ -0,0 +1,110 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// asf
+#include "conf_board.h"
+#include "cycle_counter.h"
+
+// libavr32
+#include "events.h"
+
+// this
+#include "dispatch.h"
+#include "event_ring.h"
+#include "profile.h"
+
+#define LOW_LANE_BUDGET (FMCK_HZ / 1000) // cycles of ui handlers per pass (1ms)
+
+typedef struct {
+  event_t event[LANE_SIZE];
+  u8 head;
+  u8 count;
+} lane_t;
+
+// clang-format off
+static const bool timing_event[kNumEventTypes] = {
+  [kEventFront] = true,
+  [kEventClockNormal] = true,
+  [kEventClockExt] = true,
+  [kEventTr] = true,
+  [kEventTrNormal] = true,
+};
+// clang-format on
+
+static lane_t timing_lane;
+static lane_t ui_lane;
+static event_ring_t timer_ring; // posted to from the soft timer callbacks
+static event_ring_t input_ring; // posted to from the clock input interrupt
+
+static void lane_push(lane_t *l, event_t *e) {
+  l->event[(l->head + l->count) & (LANE_SIZE - 1)] = *e;
+  l->count++;
+}
+
+static bool lane_pop(lane_t *l, event_t *e) {
+  if (l->count == 0) {
+    return false;
+  }
+  *e = l->event[l->head];
+  l->head = (l->head + 1) & (LANE_SIZE - 1);
+  l->count--;
+  return true;
+}
+
+static void fill_lanes(void) {
+  static event_t e;
+  // the rings only fill between visits, so their depth peaks here
+  PROFILE_RING_DEPTH(event_ring_depth(&input_ring), event_ring_depth(&timer_ring));
+  // stop short of a full lane, anything left over waits in the ring or queue
+  while (timing_lane.count < LANE_SIZE && ui_lane.count < LANE_SIZE &&
+         (event_ring_next(&input_ring, &e) || event_ring_next(&timer_ring, &e) ||
+          event_next(&e))) {
+    lane_push(timing_event[e.type] ? &timing_lane : &ui_lane, &e);
+  }
+  PROFILE_DEPTH(timing_lane.count + ui_lane.count);
+}
+
+static void dispatch_event(event_t *e) {
+  PROFILE_BEGIN();
+  (app_event_handlers)[e->type](e->data);
+  PROFILE_EVENT_END(e->type);
+}
+
+void dispatch_post(event_t *e) {
+  if (!event_post(e)) {
+    PROFILE_DROP();
+  }
+}
+
+void dispatch_post_timer(etype type, bool coalesce) {
+  if (!event_ring_post(&timer_ring, type, 0, coalesce)) {
+    PROFILE_DROP();
+  }
+}
+
+void dispatch_post_input(etype type, s32 data) {
+  if (!event_ring_post(&input_ring, type, data, false)) {
+    PROFILE_DROP();
+  }
+}
+
+void dispatch_check(void) {
+  static event_t e;
+
+  fill_lanes();
+  while (lane_pop(&timing_lane, &e)) {
+    dispatch_event(&e);
+  }
+
+  u32 start = Get_sys_count();
+  while (lane_pop(&ui_lane, &e)) {
+    dispatch_event(&e);
+    fill_lanes();
+    if (timing_lane.count || Get_sys_count() - start > LOW_LANE_BUDGET) {
+      break;
+    }
+  }
+}
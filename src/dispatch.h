@@ -0,0 +1,34 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+// libavr32
+#include "compiler.h"
+#include "events.h"
+#include "types.h"
+
+//
+// app event loop
+//
+// events are pulled off the clock input ring, the timer ring and the shared
+// queue into two lanes. timing events (clock, trigger, and front button) are
+// always handled first, ui events are then handled in batches bounded by
+// LOW_LANE_BUDGET. the sources are checked again after each ui event so a
+// timing event never waits on more than one ui handler.
+//
+
+#define LANE_SIZE 16 // power of two
+
+// shared libavr32 queue, from the main loop
+void dispatch_post(event_t *e);
+// timer ring, from the soft timer callbacks only
+void dispatch_post_timer(etype type, bool coalesce);
+// clock input ring, from the clock input interrupt only
+void dispatch_post_input(etype type, s32 data);
+
+// handles whatever is waiting, called from the main loop
+void dispatch_check(void);
@@ -0,0 +1,50 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// this
+#include "event_ring.h"
+
+// keep the compiler from moving the slot accesses past the index update
+#define RING_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+bool event_ring_post(event_ring_t *r, etype type, s32 data, bool coalesce) {
+  if (coalesce && r->pending[type]) {
+    return true;
+  }
+
+  u8 head = r->head;
+  if ((u8)(head - r->tail) == EVENT_RING_SIZE) {
+    return false;
+  }
+
+  event_t *e = &r->event[head & (EVENT_RING_SIZE - 1)];
+  e->type = type;
+  e->data = data;
+  if (coalesce) {
+    r->pending[type] = 1;
+  }
+
+  RING_BARRIER();
+  r->head = head + 1;
+  return true;
+}
+
+bool event_ring_next(event_ring_t *r, event_t *e) {
+  u8 tail = r->tail;
+  if (tail == r->head) {
+    return false;
+  }
+
+  RING_BARRIER();
+  *e = r->event[tail & (EVENT_RING_SIZE - 1)];
+  // cleared before the slot is released, a post racing with this either
+  // coalesces into the event just taken or queues behind it
+  r->pending[e->type] = 0;
+
+  RING_BARRIER();
+  r->tail = tail + 1;
+  return true;
+}
@@ -0,0 +1,41 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+// libavr32
+#include "compiler.h"
+#include "events.h"
+#include "types.h"
+
+//
+// event ring
+//
+// single producer (an interrupt source) / single consumer (the main loop)
+// queue of events. the producer only ever writes head and the consumer only
+// ever writes tail so neither side needs interrupts masked.
+//
+// events posted with coalesce set are dropped while an event of the same
+// type is still waiting, handlers which poll current state (refresh, adc)
+// only need to run once however many ticks went by.
+//
+
+#define EVENT_RING_SIZE 16 // power of two
+
+typedef struct {
+  event_t event[EVENT_RING_SIZE];
+  volatile u8 head;                    // next slot to fill, producer only
+  volatile u8 tail;                    // next slot to take, consumer only
+  volatile u8 pending[kNumEventTypes]; // coalesced types waiting in the ring
+} event_ring_t;
+
+bool event_ring_post(event_ring_t *r, etype type, s32 data, bool coalesce);
+bool event_ring_next(event_ring_t *r, event_t *e);
+
+// events waiting, for the consumer
+static inline u8 event_ring_depth(event_ring_t *r) {
+  return r->head - r->tail;
+}
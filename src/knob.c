@@ -0,0 +1,57 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// this
+#include "knob.h"
+
+void knob_init(knob_t *k) {
+  k->filter = 0;
+  k->value = 0;
+  k->idle = KNOB_IDLE_POLLS;
+  k->dir = 0;
+  k->primed = 0;
+}
+
+// returns true if the reported value moved
+bool knob_update(knob_t *k, u16 sample) {
+  if (!k->primed) {
+    k->filter = (s32)sample << KNOB_FRAC;
+    k->value = sample;
+    k->primed = 1;
+    return true;
+  }
+
+  k->filter += (((s32)sample << KNOB_FRAC) - k->filter) >> KNOB_IIR_SHIFT;
+
+  s16 f = (k->filter + (1 << (KNOB_FRAC - 1))) >> KNOB_FRAC;
+
+  // snap to the ends of travel so they stay reachable through the band
+  if (f < KNOB_DEADBAND) {
+    f = 0;
+  } else if (f > KNOB_MAX - KNOB_DEADBAND) {
+    f = KNOB_MAX;
+  }
+
+  s16 delta = f - (s16)k->value;
+  s8 dir = delta > 0 ? 1 : -1;
+  s16 band = knob_moving(k) && dir == k->dir ? KNOB_HYSTERESIS : KNOB_DEADBAND;
+
+  if (delta >= band || delta <= -band || (delta != 0 && (f == 0 || f == KNOB_MAX))) {
+    k->value = f;
+    k->idle = 0;
+    k->dir = dir;
+    return true;
+  }
+
+  if (k->idle < KNOB_IDLE_POLLS) {
+    k->idle++;
+  }
+  return false;
+}
+
+bool knob_moving(knob_t *k) {
+  return k->idle < KNOB_IDLE_POLLS;
+}
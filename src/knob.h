@@ -0,0 +1,41 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+// libavr32
+#include "compiler.h"
+#include "types.h"
+
+//
+// knob
+//
+// smooths the (oversampled) readings of a pot with a fixed point one pole
+// filter. the reported value only moves once the filtered reading leaves a
+// deadband around it. while the knob is being turned the band narrows in the
+// direction of travel so small movements are still followed, turning back
+// (or noise) has to clear the full band.
+//
+
+#define KNOB_MAX 4095       // 12 bit adc
+#define KNOB_OVERSAMPLE 4   // conversions averaged per poll
+#define KNOB_FRAC 4         // fractional bits kept by the filter
+#define KNOB_IIR_SHIFT 2    // each poll moves the filter 1/4 of the way
+#define KNOB_DEADBAND 12    // change needed to move a knob at rest
+#define KNOB_HYSTERESIS 3   // change needed to keep a turning knob moving
+#define KNOB_IDLE_POLLS 16  // polls without movement until the knob is at rest
+
+typedef struct {
+  s32 filter; // filtered reading, KNOB_FRAC fractional bits
+  u16 value;  // last reported value [0-KNOB_MAX]
+  u8 idle;    // polls since the value last moved
+  s8 dir;     // direction of the last move
+  u8 primed;  // filter has been loaded with a first reading
+} knob_t;
+
+void knob_init(knob_t *k);
+bool knob_update(knob_t *k, u16 sample);
+bool knob_moving(knob_t *k);
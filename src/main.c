@@ -7,6 +7,7 @@
 
 // asf
 #include "compiler.h"
+#include "cycle_counter.h"
 #include "delay.h"
 #include "flashc.h"
 #include "gpio.h"
@@ -37,27 +38,35 @@
 // this
 #include "conf_board.h"
 
+#include "dispatch.h"
+#include "event_ring.h"
+#include "knob.h"
 #include "main.h"
 #include "mode_arc.h"
 #include "mode_div.h"
 #include "mode_grid.h"
 #include "mode_midi.h"
+#include "profile.h"
 
 #include "gitversion.h"
 
-#define FIRSTRUN_KEY 0x22
+#define FIRSTRUN_KEY 0x27
+
+#define PROFILE_REPORT_TICKS 100 // key timer ticks (50ms) between reports
+#define PROFILE_DUMP_HOLD 60     // key timer ticks the front button is held to dump event stats
 
 ////////////////////////////////////////////////////////////////////////////////
 // prototypes
 
-void clock_null(u8 phase);
+u16 clock_input_null(u8 level);
 
 // start/stop monome polling/refresh timers
 extern void timers_set_monome(void);
 extern void timers_unset_monome(void);
 
-// check the event queue
-static void check_events(void);
+static void post_front_long(void);
+static void irq_clock_input(void);
+static void irq_front(void);
 
 // handler protos (internal)
 static void handler_KeyTimer(s32 data);
@@ -87,17 +96,57 @@ static const u8 grid_outs[8] = {B00, B02, B04, B06, B01, B03, B05, B07};
 
 static const u8 *outs;
 
+// all trigger outputs live on the same gpio port, B00 - B07, so a mask of
+// outputs can be written with a single set or clear register write
+#define TR_PORT (B00 >> 5)
+#define TR_SHIFT (B00 & 0x1f)
+
+// output mask to port bits, these mirror the *_outs pin mappings above
+#define NORMAL_OUT_BITS(m) (m)
+#define GRID_OUT_BITS(m)                                                                           \
+  ((((m)&0x01) << 0) | (((m)&0x02) << 1) | (((m)&0x04) << 2) | (((m)&0x08) << 3) |                 \
+   (((m)&0x10) >> 3) | (((m)&0x20) >> 2) | (((m)&0x40) >> 1) | ((m)&0x80))
+
+#define OUT_BITS_4(f, m) f(m), f((m) + 1), f((m) + 2), f((m) + 3)
+#define OUT_BITS_16(f, m)                                                                          \
+  OUT_BITS_4(f, m), OUT_BITS_4(f, (m) + 4), OUT_BITS_4(f, (m) + 8), OUT_BITS_4(f, (m) + 12)
+#define OUT_BITS_64(f, m)                                                                          \
+  OUT_BITS_16(f, m), OUT_BITS_16(f, (m) + 16), OUT_BITS_16(f, (m) + 32), OUT_BITS_16(f, (m) + 48)
+#define OUT_BITS_256(f)                                                                            \
+  OUT_BITS_64(f, 0), OUT_BITS_64(f, 64), OUT_BITS_64(f, 128), OUT_BITS_64(f, 192)
+
+static const u8 normal_out_bits[256] = {OUT_BITS_256(NORMAL_OUT_BITS)};
+static const u8 grid_out_bits[256] = {OUT_BITS_256(GRID_OUT_BITS)};
+
+static const u8 *out_bits = normal_out_bits;
+
 ////////////////////////////////////////////////////////////////////////////////
 // globals
 
 connected_t connected;
 bool external_clock;
+u16 (*clock_input)(u8 level) = &clock_input_null;
 
-static uint8_t clock_phase;
 static uint8_t front_timer;
+#ifdef TRANSIT_PROFILE
+// a long press is held back until release so a hold to PROFILE_DUMP_HOLD
+// dumps the event stats without also being a long press
+static bool front_long_held;
+#endif
+static volatile u32 front_edge;  // time of the last front button edge
+static volatile u32 front_press; // time of the last front button press
+
+// edges closer together than this are contact bounce
+#define FRONT_BOUNCE (FMCK_HZ / 100)
 
 u16 adc[4];
 
+// the knob is polled quickly while it is being turned, slowly at rest
+#define ADC_POLL_IDLE 100
+#define ADC_POLL_MOVING 20
+
+static knob_t rate_knob;
+
 static transit_mode_t active_mode;
 
 __attribute__((__section__(".flash_nvram"))) nvram_data_t f;
@@ -105,7 +154,6 @@ __attribute__((__section__(".flash_nvram"))) nvram_data_t f;
 ////////////////////////////////////////////////////////////////////////////////
 // timers
 
-static softTimer_t clockTimer = {.next = NULL, .prev = NULL};
 static softTimer_t keyTimer = {.next = NULL, .prev = NULL};
 static softTimer_t adcTimer = {.next = NULL, .prev = NULL};
 static softTimer_t monomePollTimer = {.next = NULL, .prev = NULL};
@@ -115,25 +163,13 @@ static softTimer_t midiPollTimer = {.next = NULL, .prev = NULL};
 ////////////////////////////////////////////////////////////////////////////////
 // timer callbacks
 
-static void clockTimer_callback(void *o) {
-  clock_phase++;
-  if (clock_phase > 1)
-    clock_phase = 0;
-  clock(clock_phase);
-}
-
 static void keyTimer_callback(void *o) {
-  static event_t e;
-  e.type = kEventKeyTimer;
-  e.data = 0;
-  event_post(&e);
+  // not coalesced, the key timer ticks are counted for holds
+  dispatch_post_timer(kEventKeyTimer, false);
 }
 
 static void adcTimer_callback(void *o) {
-  static event_t e;
-  e.type = kEventPollADC;
-  e.data = 0;
-  event_post(&e);
+  dispatch_post_timer(kEventPollADC, true);
 }
 
 static void monome_poll_timer_callback(void *obj) {
@@ -142,9 +178,7 @@ static void monome_poll_timer_callback(void *obj) {
 
 static void monome_refresh_timer_callback(void *obj) {
   if (monomeFrameDirty > 0) {
-    static event_t e;
-    e.type = kEventMonomeRefresh;
-    event_post(&e);
+    dispatch_post_timer(kEventMonomeRefresh, true);
   }
 }
 
@@ -187,25 +221,32 @@ void set_mode(transit_mode_t m) {
     break;
   }
 
+  // modes which act on the clock input from its interrupt set their own
+  clock_input = &clock_input_null;
+
   // enter
   switch (m) {
   case mGrid:
     outs = grid_outs;
+    out_bits = grid_out_bits;
     enter_mode_grid();
     active_mode = m;
     break;
   case mArc:
     outs = normal_outs;
+    out_bits = normal_out_bits;
     enter_mode_arc();
     active_mode = m;
     break;
   case mMidi:
     outs = normal_outs;
+    out_bits = normal_out_bits;
     enter_mode_midi();
     active_mode = m;
     break;
   case mDiv:
     outs = normal_outs;
+    out_bits = normal_out_bits;
     enter_mode_div();
     active_mode = m;
     break;
@@ -220,24 +261,20 @@ void set_mode(transit_mode_t m) {
 void handler_None(s32 data) {
 }
 
-void handler_PollADC(s32 data) {
-  static u16 clock_last = 10000;
-  u16 i, clock_time;
-
-  adc_convert(&adc);
-
-  i = adc[0];
-  i = i >> 2;
+u16 poll_knob(void) {
+  u32 sum = 0;
+  for (u8 i = 0; i < KNOB_OVERSAMPLE; i++) {
+    adc_convert(&adc);
+    sum += adc[0];
+  }
 
-  if (i != clock_last) {
-    // 500ms - 12ms
-    clock_time = 25000 / (i + 25);
-    // print_dbg("\r\nclock (ms): ");
-    // print_dbg_ulong(clock_time);
-    clock_set(clock_time);
+  bool was_moving = knob_moving(&rate_knob);
+  knob_update(&rate_knob, sum / KNOB_OVERSAMPLE);
+  if (knob_moving(&rate_knob) != was_moving) {
+    timer_set(&adcTimer, was_moving ? ADC_POLL_IDLE : ADC_POLL_MOVING);
   }
 
-  clock_last = i;
+  return rate_knob.value;
 }
 
 static void handler_FtdiConnect(s32 data) {
@@ -306,12 +343,25 @@ static void handler_Front(s32 data) {
       static event_t e;
       e.type = kEventFrontShort;
       e.data = 0;
-      event_post(&e);
+      dispatch_post(&e);
     }
     front_timer = 0;
+#ifdef TRANSIT_PROFILE
+    if (front_long_held) {
+      front_long_held = false;
+      post_front_long();
+    }
+#endif
   }
 }
 
+static void post_front_long(void) {
+  static event_t e;
+  e.type = kEventFrontLong;
+  e.data = 0;
+  dispatch_post(&e);
+}
+
 static void handler_FrontShort(s32 data) {
   if (connected == conNONE) {
     print_dbg("\r\n explicit switch to div");
@@ -334,21 +384,40 @@ static void handler_KeyTimer(s32 data) {
     static event_t e;
     e.type = kEventFront;
     e.data = keyfront_state;
-    event_post(&e);
+    dispatch_post(&e);
   }
 
   if (front_timer) {
     if (front_timer == 1) {
-      static event_t e;
-      e.type = kEventFrontLong;
-      e.data = 0;
-      event_post(&e);
+#ifdef TRANSIT_PROFILE
+      front_long_held = true;
+#else
+      post_front_long();
+#endif
       front_timer = 0;
     } else {
       front_timer--;
     }
   }
 
+#ifdef TRANSIT_PROFILE
+  static u8 profile_timer;
+  if (++profile_timer == PROFILE_REPORT_TICKS) {
+    profile_timer = 0;
+    profile_report();
+  }
+
+  // holding the front button well past a long press dumps the event stats
+  // instead of posting the long press
+  static u8 dump_hold;
+  if (!keyfront_state) {
+    dump_hold = 0;
+  } else if (dump_hold < PROFILE_DUMP_HOLD && ++dump_hold == PROFILE_DUMP_HOLD) {
+    front_long_held = false;
+    event_stats_report();
+  }
+#endif
+
   switch (connected) {
   case conGRID:
     keytimer_grid();
@@ -361,6 +430,9 @@ static void handler_KeyTimer(s32 data) {
     break;
   case conFLASH:
   case conNONE:
+    if (active_mode == mDiv) {
+      keytimer_div();
+    }
     break;
   }
 }
@@ -371,7 +443,7 @@ static void handler_ClockNormal(s32 data) {
 
 static void handler_ClockExt(s32 data) {
   print_dbg("\r\n clock ext: ");
-  print_dbg_ulong(data);
+  print_dbg_ulong(clock_edge(data)->level);
 }
 
 // assign default event handlers
@@ -379,7 +451,7 @@ static inline void assign_main_event_handlers(void) {
   app_event_handlers[kEventFront] = &handler_Front;
   app_event_handlers[kEventFrontShort] = &handler_FrontShort;
   app_event_handlers[kEventFrontLong] = &handler_FrontLong;
-  app_event_handlers[kEventPollADC] = &handler_PollADC;
+  app_event_handlers[kEventPollADC] = &handler_None;
   app_event_handlers[kEventKeyTimer] = &handler_KeyTimer;
   app_event_handlers[kEventSaveFlash] = &handler_SaveFlash;
   app_event_handlers[kEventFtdiConnect] = &handler_FtdiConnect;
@@ -399,12 +471,74 @@ static inline void assign_main_event_handlers(void) {
   app_event_handlers[kEventSerialDisconnect] = &handler_FtdiDisconnect;
 }
 
-// app event loop
-void check_events(void) {
-  static event_t e;
-  if (event_next(&e)) {
-    (app_event_handlers)[e.type](e.data);
+// clock input edges as taken by the interrupt, kEventClockExt carries the slot.
+// there are more slots than the input ring holds events so a slot is never
+// reused while its event is still waiting.
+#define CLOCK_EDGES (EVENT_RING_SIZE * 2) // power of two
+static clock_edge_t clock_edges[CLOCK_EDGES];
+static u8 clock_edge_next;
+
+// gpio interrupts are shared by the 8 pins of a line, a handler which takes
+// over a line acts on the pins it knows and clears the flags of any others so
+// they can't hold the interrupt asserted
+#define PIN_BIT(pin) (1UL << ((pin)&0x1f))
+
+static inline u32 gpio_line_flags(u32 pin) {
+  return AVR32_GPIO.port[pin >> 5].ifr & (0xffUL << (pin & 0x18));
+}
+
+static inline void gpio_line_clear(u32 pin, u32 flags) {
+  AVR32_GPIO.port[pin >> 5].ifrc = flags;
+}
+
+// takes over the libavr32 handler for the B08 - B15 line so the mode can act
+// on a clock input edge (reset) from the interrupt, the clock events are
+// still posted for everything which can wait for the main loop
+__attribute__((__interrupt__)) static void irq_clock_input(void) {
+  // flags are cleared before the pins are read so an edge arriving
+  // meanwhile interrupts again
+  u32 flags = gpio_line_flags(B08);
+  gpio_line_clear(B08, flags);
+
+  if (flags & PIN_BIT(B09)) {
+    dispatch_post_input(kEventClockNormal, !gpio_get_pin_value(B09));
   }
+
+  if (flags & PIN_BIT(B08)) {
+    // the edge time and phasor tick are taken here, by the time the event is
+    // handled the main loop may have been busy for a while
+    u8 slot = clock_edge_next;
+    clock_edge_t *e = &clock_edges[slot];
+    e->time = Get_sys_count();
+    e->level = gpio_get_pin_value(B08);
+    e->tick = (*clock_input)(e->level);
+    clock_edge_next = (slot + 1) & (CLOCK_EDGES - 1);
+    dispatch_post_input(kEventClockExt, slot);
+  }
+}
+
+const clock_edge_t *clock_edge(s32 data) {
+  return &clock_edges[data & (CLOCK_EDGES - 1)];
+}
+
+// the key timer debounces the front button for the ui, this only timestamps
+// presses so tap tempo isn't limited to the key timer resolution
+__attribute__((__interrupt__)) static void irq_front(void) {
+  // this takes over the whole PA08 - PA15 line, see irq_clock_input
+  u32 flags = gpio_line_flags(NMI);
+  gpio_line_clear(NMI, flags);
+
+  if (flags & PIN_BIT(NMI)) {
+    u32 now = Get_sys_count();
+    if (!gpio_get_pin_value(NMI) && now - front_edge > FRONT_BOUNCE) {
+      front_press = now;
+    }
+    front_edge = now;
+  }
+}
+
+u32 front_press_time(void) {
+  return front_press;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -442,31 +576,29 @@ void flash_read(void) {
 // functions
 
 void set_tr(uint8_t n) {
-  gpio_set_gpio_pin(outs[n]);
+  AVR32_GPIO.port[TR_PORT].ovrs = out_bits[1 << n] << TR_SHIFT;
 }
 
 void clr_tr(uint8_t n) {
-  gpio_clr_gpio_pin(outs[n]);
+  AVR32_GPIO.port[TR_PORT].ovrc = out_bits[1 << n] << TR_SHIFT;
+}
+
+void set_tr_mask(uint8_t set, uint8_t clr) {
+  volatile avr32_gpio_port_t *port = &AVR32_GPIO.port[TR_PORT];
+  port->ovrc = out_bits[clr] << TR_SHIFT;
+  port->ovrs = out_bits[set] << TR_SHIFT;
 }
 
 void clr_tr_all(void) {
-  for (u8 i = 0; i < 8; i++) {
-    clr_tr(i);
-  }
+  AVR32_GPIO.port[TR_PORT].ovrc = 0xff << TR_SHIFT;
 }
 
 uint8_t get_tr(uint8_t n) {
   return gpio_get_pin_value(outs[n]);
 }
 
-void clock_set(uint32_t n) {
-  timer_set(&clockTimer, n);
-}
-
-void clock_set_tr(uint32_t n, uint8_t phase) {
-  timer_set(&clockTimer, n);
-  clock_phase = phase;
-  timer_manual(&clockTimer);
+u16 clock_input_null(u8 level) {
+  return 0;
 }
 
 static void ii_null(uint8_t *d, uint8_t l) {
@@ -492,6 +624,9 @@ int main(void) {
 
   irq_initialize_vectors();
   register_interrupts();
+  INTC_register_interrupt(&irq_clock_input, AVR32_GPIO_IRQ_0 + (B08 / 8), UI_IRQ_PRIORITY);
+  INTC_register_interrupt(&irq_front, AVR32_GPIO_IRQ_0 + (NMI / 8), UI_IRQ_PRIORITY);
+  gpio_enable_pin_interrupt(NMI, GPIO_PIN_CHANGE);
   cpu_irq_enable();
 
   // must be called after irq_initialize_vectors!
@@ -526,15 +661,15 @@ int main(void) {
   init_i2c_follower(0x30);
   process_ii = &ii_null;
 
+  // the gpio driver call also enables the output drivers, after this the
+  // outputs are written directly through the port registers
   for (u8 i = 0; i < 8; i++) {
-    clr_tr(i);
+    gpio_clr_gpio_pin(normal_outs[i]);
   }
 
-  clock = &clock_null;
-
-  timer_add(&clockTimer, 1000, &clockTimer_callback, NULL);
   timer_add(&keyTimer, 50, &keyTimer_callback, NULL);
-  timer_add(&adcTimer, 100, &adcTimer_callback, NULL);
+  knob_init(&rate_knob);
+  timer_add(&adcTimer, ADC_POLL_IDLE, &adcTimer_callback, NULL);
 
   connected = conNONE;
   set_mode(f.mode);
@@ -543,6 +678,6 @@ int main(void) {
   init_monome();
 
   while (true) {
-    check_events();
+    dispatch_check();
   }
 }
@@ -50,17 +50,29 @@ extern u16 adc[4];
 ////////////////////////////////////////////////////////////////////////////////
 // prototypes
 
-void (*clock)(u8 phase);
+// called from the clock input interrupt with the new level, returns the
+// mode's phasor tick count for the edge
+extern u16 (*clock_input)(u8 level);
+
+// a clock input edge, kEventClockExt data is passed to clock_edge() for it
+typedef struct {
+  u32 time; // cycle count at the edge
+  u16 tick; // as returned by clock_input
+  u8 level;
+} clock_edge_t;
+
+const clock_edge_t *clock_edge(s32 data);
 
 extern void handler_None(s32 data);
-extern void handler_PollADC(s32 data);
 
-extern void clock_null(u8 phase);
+u16 poll_knob(void);
+u32 front_press_time(void);
+
+extern u16 clock_input_null(u8 level);
 
 void set_mode(transit_mode_t m);
 void set_tr(uint8_t n);
 void clr_tr(uint8_t n);
+void set_tr_mask(uint8_t set, uint8_t clr);
 void clr_tr_all(void);
 uint8_t get_tr(uint8_t n);
-void clock_set(uint32_t n);
-void clock_set_tr(uint32_t n, uint8_t phase);
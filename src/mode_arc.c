@@ -27,10 +27,10 @@
 #include "print_funcs.h"
 
 // libavr32
-#include "adc.h"
 #include "events.h"
 #include "flashc.h"
 #include "i2c.h"
+#include "interrupts.h"
 #include "mailbox.h"
 #include "monome.h"
 #include "phasor.h"
@@ -40,6 +40,14 @@
 #include "main.h"
 #include "mode_arc.h"
 #include "mode_common.h"
+#include "profile.h"
+
+// each ring is one quadrant of the led buffer
+#define ARC_NUM_RINGS 2
+#define ARC_RING_SIZE 64
+#define RING_GATE 0x1 // ring 0, gate (play) or clock (config)
+#define RING_DIV 0x2  // ring 1, selection and divisor
+#define RING_ALL (RING_GATE | RING_DIV)
 
 //------------------------------
 //------ types
@@ -69,7 +77,9 @@ typedef struct {
   mailbox_t divisor_change;
   mailbox_t phase_change;
 
-  u16 now; // local tick count [0-effective.period)
+  u16 pos;       // local tick count [0-effective.period) as of pos_tick
+  u32 pos_tick;  // phasor tick at which pos was last synced
+  u32 next_edge; // phasor tick at which the gate level next changes
   bool fired;
   // bool cycling;    // are
 } output_t;
@@ -80,12 +90,12 @@ typedef struct {
 static void write_arc(void);
 static void read_arc(void);
 
-static void render_arc(void);
+static void render_arc(u8 rings);
+static void mark_dirty(u8 rings);
 
 static void handler_ArcPollADC(s32 data);
 static void handler_ArcFrontShort(s32 data);
 static void handler_ArcFrontLong(s32 data);
-static void handler_ArcClockExt(s32 data);
 static void handler_ArcClockNormal(s32 data);
 static void handler_ArcEnc(s32 data);
 static void handler_ArcRefresh(s32 data);
@@ -99,9 +109,11 @@ static void enc_do_play(u8 n, s8 delta);
 static void enc_do_config(u8, s8 delta);
 static void enc_set_acc_play(u8 selection);
 static void enc_set_acc_config(u8 selection);
+static u16 arc_bpm_quarters(void);
 
 // callback for phasor
 static void process_outputs(u8 now, bool reset);
+static u16 arc_clock_input(u8 level);
 
 //-----------------------------
 //----- globals
@@ -113,10 +125,16 @@ static bool fresh = false;
 static s32 enc_acc[4];
 
 static output_t output[8];
-static u16 clock_hz;
+static u32 ticks;              // phasor ticks since power up
+static u32 next_due;           // earliest next_edge of all outputs
+static volatile u8 reschedule; // outputs whose gate was edited outside of the phasor callback
+static tempo_t tempo;  // base clock
+static u16 phasor_hz; // rate the phasor was last set to
 static u16 ext_clock_width = MAX_WIDTH >> 1;
 
 static u8 selection;
+static u8 ring_dirty;                                 // rings which need to be rendered
+static u8 ring_shadow[ARC_NUM_RINGS * ARC_RING_SIZE]; // levels last sent to the arc
 
 static ui_mode_t ui_mode;
 
@@ -128,7 +146,7 @@ void enter_mode_arc(void) {
   read_arc();
 
   app_event_handlers[kEventPollADC] = &handler_ArcPollADC;
-  app_event_handlers[kEventClockExt] = &handler_ArcClockExt;
+  app_event_handlers[kEventClockExt] = &handler_None; // reset is taken from the interrupt
   app_event_handlers[kEventClockNormal] = &handler_ArcClockNormal;
   app_event_handlers[kEventMonomeRingEnc] = &handler_ArcEnc;
   app_event_handlers[kEventMonomeRefresh] = &handler_ArcRefresh;
@@ -137,7 +155,7 @@ void enter_mode_arc(void) {
 
   resume_arc();
 
-  clock = &clock_null;
+  clock_input = &arc_clock_input;
 
   process_ii = &ii_arc;
 
@@ -146,9 +164,16 @@ void enter_mode_arc(void) {
     app_event_handlers[kEventFrontLong] = &handler_ArcFrontLong;
   }
 
-  clock_hz = calc_clock_frequency(arc_state.clock_rate);
+  // outputs keep their position, restart the edge schedule from here
+  for (u8 i = 0; i < 8; i++) {
+    output[i].pos_tick = ticks;
+  }
+  reschedule = 0xff;
+
+  tempo_set_bpm(&tempo, arc_state.bpm);
+  phasor_hz = tempo_next_hz(&tempo);
   phasor_set_callback(&process_outputs);
-  phasor_setup(clock_hz, PPQ);
+  phasor_setup(phasor_hz, PPQ);
   phasor_start();
 }
 
@@ -165,9 +190,7 @@ void handler_ArcPollADC(s32 data) {
   static u16 last = 10000;
   u16 p;
 
-  adc_convert(&adc);
-
-  p = adc[0] >> 9;
+  p = poll_knob() >> 9;
   if (p != last) {
     // print_dbg("\r\n arc: poll adc ");
     // print_dbg_ulong(p);
@@ -180,7 +203,7 @@ void handler_ArcPollADC(s32 data) {
       enc_set_acc_config(selection);
     }
 
-    monomeFrameDirty++;
+    mark_dirty(RING_ALL);
   }
 }
 
@@ -189,11 +212,12 @@ void handler_ArcFrontShort(s32 data) {
   // print_dbg_ulong(data);
   if (ui_mode == uiPlay) {
     output[selection].selected = !output[selection].selected;
+    mark_dirty(RING_DIV);
   } else if (ui_mode == uiConfig) {
     enc_set_acc_play(selection);
     ui_mode = uiPlay;
+    mark_dirty(RING_GATE);
   }
-  monomeFrameDirty++;
 }
 
 void handler_ArcFrontLong(s32 data) {
@@ -201,13 +225,7 @@ void handler_ArcFrontLong(s32 data) {
   // print_dbg_ulong(data);
   enc_set_acc_config(selection);
   ui_mode = uiConfig;
-  monomeFrameDirty++;
-}
-
-void handler_ArcClockExt(s32 data) {
-  if (data) {
-    phasor_reset();
-  }
+  mark_dirty(RING_GATE);
 }
 
 void handler_ArcClockNormal(s32 data) {
@@ -218,6 +236,9 @@ void handler_ArcEnc(s32 data) {
   u8 n;
   s8 delta;
 
+  // encoder events only update state and mark rings, however many arrive
+  // between refreshes they are drawn and sent once by handler_ArcRefresh
+
   monome_ring_enc_parse_event_data(data, &n, &delta);
 
   if (ui_mode == uiPlay) {
@@ -228,16 +249,35 @@ void handler_ArcEnc(s32 data) {
 }
 
 void handler_ArcRefresh(s32 data) {
-  if (monomeFrameDirty) {
-    render_arc();
-    monome_set_quadrant_flag(0);
-    monome_set_quadrant_flag(1);
-    // monome_set_quadrant_flag(2);
-    // monome_set_quadrant_flag(3);
+  u8 rings = ring_dirty;
+  u8 quadrants = 0;
+
+  ring_dirty = 0;
+  if (rings) {
+    render_arc(rings);
+    for (u8 n = 0; n < ARC_NUM_RINGS; n++) {
+      u8 *leds = &monomeLedBuffer[n * ARC_RING_SIZE];
+      u8 *shadow = &ring_shadow[n * ARC_RING_SIZE];
+      if ((rings & (1 << n)) && memcmp(leds, shadow, ARC_RING_SIZE)) {
+        memcpy(shadow, leds, ARC_RING_SIZE);
+        quadrants |= 1 << n;
+      }
+    }
+  }
+
+  // the dirty count doubles as the quadrant flags, replace it wholesale so
+  // only rings which changed are sent
+  monomeFrameDirty = quadrants;
+  if (quadrants) {
     (*monome_refresh)();
   }
 }
 
+static void mark_dirty(u8 rings) {
+  ring_dirty |= rings;
+  monomeFrameDirty++;
+}
+
 //////////////////////////////////////////////////
 ///// app
 
@@ -256,6 +296,7 @@ static void set_output_phase(u8 n, u16 phase) {
   u16 t = uclip(phase, 0, MAX_PHASE);
   output[n].base.phase = t;
   output[n].effective.phase = t * output[n].divisor;
+  reschedule |= 1 << n;
 
   // print_dbg("\r\n > phase n: ");
   // print_dbg_ulong(n);
@@ -274,6 +315,7 @@ static void set_output_width(u8 n, u16 width) {
   u16 t = uclip(width, 1, MAX_WIDTH);
   output[n].base.width = t;
   output[n].effective.width = t * output[n].divisor;
+  reschedule |= 1 << n;
 
   // print_dbg("\r\n > width n: ");
   // print_dbg_ulong(n);
@@ -287,6 +329,7 @@ static void set_output_period(u8 n, u16 period) {
   u16 t = uclip(period, 1, MAX_PERIOD);
   output[n].base.period = t;
   output[n].effective.period = t * output[n].divisor;
+  reschedule |= 1 << n;
 
   // print_dbg("\r\n > period n: ");
   // print_dbg_ulong(n);
@@ -309,8 +352,10 @@ static void reset_output(u8 n) {
   set_output_width(n, MAX_WIDTH >> 1);
   set_output_period(n, MAX_PERIOD);
 
-  output[n].now = 0;
+  output[n].pos = 0;
+  output[n].pos_tick = ticks;
   output[n].fired = false;
+  reschedule |= 1 << n;
   // output[n].cycling = false;
 }
 
@@ -327,7 +372,7 @@ static void enc_set_acc_play(u8 selection) {
 }
 
 static void enc_set_acc_config(u8 selection) {
-  enc_acc[0] = arc_state.clock_rate << 5;
+  enc_acc[0] = arc_bpm_quarters() << 5;
   enc_acc[1] = output[selection].divisor << 7;
 }
 
@@ -345,14 +390,14 @@ static void enc_do_play(u8 n, s8 delta) {
     t = sclip(enc_acc[0] >> 7, 0, PPQ);
     if (t != output[selection].base.phase) {
       set_output_phase(selection, t);
-      monomeFrameDirty++;
+      mark_dirty(RING_GATE);
     }
     break;
   case 1:
     t = sclip(enc_acc[1] >> 7, 0, PPQ);
     if (t != output[selection].base.width) {
       set_output_width(selection, t);
-      monomeFrameDirty++;
+      mark_dirty(RING_GATE);
     }
     break;
   default:
@@ -364,25 +409,22 @@ static void enc_do_config(u8 n, s8 delta) {
   message_t msg;
   u8 i;
   u8 d;
-  u16 hz, rate;
+  u16 rate;
 
   switch (n) {
   case 0:
     // clock
     delta = sclip(delta, -15, 15);
     delta = delta > 0 ? delta_acc[delta] : -delta_acc[-delta];
-    enc_acc[n] = sclip(enc_acc[n] + delta, 0, 1280 << 5);
+    enc_acc[n] = sclip(enc_acc[n] + delta, (BPM_MIN >> 14) << 5, 1280 << 5);
 
+    // quarter bpm steps
     rate = enc_acc[n] >> 5;
-    if (rate != arc_state.clock_rate) {
-      arc_state.clock_rate = rate;
-      clock_hz = calc_clock_frequency(arc_state.clock_rate);
-      hz = phasor_set_frequency(clock_hz);
+    if (rate != arc_bpm_quarters()) {
+      arc_set_bpm(fix16_from_int(rate) >> 2);
       // print_dbg("\r\nclock: ");
-      // print_dbg_ulong(arc_state.clock_rate);
-      // print_dbg(" hz: ");
-      // print_dbg_ulong(hz);
-      monomeFrameDirty++;
+      // print_dbg_ulong(fix16_to_int(arc_state.bpm));
+      mark_dirty(RING_GATE);
     }
     break;
   case 1:
@@ -400,7 +442,7 @@ static void enc_do_config(u8 n, s8 delta) {
         mailbox_post(&output[i].divisor_change, &msg, kPostReplace);
       }
     }
-    monomeFrameDirty++;
+    mark_dirty(RING_DIV);
     break;
   default:
     break;
@@ -462,92 +504,157 @@ static void arc_draw_clock(void) {
     monomeLedBuffer[p + 1] = L1;
   }
 
-  // 1280 / 64 == 20
-  p = uclip(offset + arc_state.clock_rate / 20, 0, 63);
+  // 1280 quarter bpm / 64 == 20
+  p = uclip(offset + arc_bpm_quarters() / 20, 0, 63);
   monomeLedBuffer[p] = L3;
 }
 
-static void render_arc(void) {
-  memset(monomeLedBuffer, 0, MONOME_MAX_LED_BYTES);
+static void render_arc(u8 rings) {
+  if (rings & RING_GATE) {
+    memset(monomeLedBuffer, 0, ARC_RING_SIZE);
+    if (ui_mode == uiPlay)
+      arc_draw_gate(selection);
+    else if (ui_mode == uiConfig)
+      arc_draw_clock();
+  }
+
+  if (rings & RING_DIV) {
+    memset(monomeLedBuffer + ARC_RING_SIZE, 0, ARC_RING_SIZE);
+    arc_draw_selected();
+    arc_draw_divisor(selection);
+  }
+}
+
+// bring the local position of an output up to the current tick. outputs are
+// synced at least on every edge so at most one period can have elapsed.
+static void sync_output(output_t *o) {
+  if (o->pos_tick != ticks) {
+    o->pos += ticks - o->pos_tick;
+    if (o->pos >= o->effective.period) {
+      o->pos -= o->effective.period;
+    }
+    o->pos_tick = ticks;
+  }
+}
+
+// set the gate level for the current position and work out when it next
+// changes; the gate is high for [phase, phase + width) of each period
+static void update_output(u8 n, u8 *set, u8 *clr) {
+  output_t *o = &output[n];
+  s32 d = o->pos - o->effective.phase;
+
+  if (d < 0) {
+    d = o->effective.period + d;
+  }
+
+  if (d < o->effective.width) {
+    if (!o->fired) {
+      *set |= 1 << n;
+      o->fired = true;
+    }
+    o->next_edge = ticks + (o->effective.width - d);
+  } else {
+    if (o->fired) {
+      *clr |= 1 << n;
+      o->fired = false;
+    }
+    o->next_edge = ticks + (o->effective.period - d);
+  }
 
-  if (ui_mode == uiPlay)
-    arc_draw_gate(selection);
-  else if (ui_mode == uiConfig)
-    arc_draw_clock();
+  if (o->pos >= o->effective.period) {
+    // divisor shrank past the current position, start over on the next tick
+    o->pos = o->effective.period - 1;
+    o->next_edge = ticks + 1;
+  }
+}
 
-  arc_draw_selected();
-  arc_draw_divisor(selection);
+// called from the clock input interrupt, the phasor restarts on the next tick
+// rather than once the event makes it through the queue
+static u16 arc_clock_input(u8 level) {
+  if (level) {
+    phasor_reset();
+  }
+  return ticks;
 }
 
 static void process_outputs(u8 now, bool reset) {
   message_t msg;
   u8 i;
-  s32 n;
+  u8 due = 0;
+  u8 set = 0, clr = 0;
 
-  // print_dbg("\r\nprocess: ");
-  // print_dbg_ulong(now);
+  PROFILE_BEGIN();
 
   // sync all
   if (reset) {
+    clr_tr_all();
     for (i = 0; i < 8; i++) {
-      clr_tr(i);
-      output[i].now = now * output[i].divisor;
+      output[i].pos = now * output[i].divisor;
+      output[i].pos_tick = ticks;
       output[i].fired = false;
-      // output[i].cycling = false;
     }
+    due = 0xff;
   }
 
   if (now == 0) {
     gpio_set_gpio_pin(B10); // ext clock
 
+    // switch between the whole hz rates either side of the tempo
+    u16 hz = tempo_next_hz(&tempo);
+    if (hz != phasor_hz) {
+      phasor_hz = hz;
+      phasor_set_frequency(hz);
+    }
+
     // apply queued division changes at base phasor cycle start
     for (i = 0; i < 8; i++) {
       if (mailbox_get(&output[i].divisor_change, &msg)) {
-        // tweak divisor
-        // set_output_divisor(i, msg.data);
+        // position is relative to the old period
+        sync_output(&output[i]);
         calc_effective_divisor(i);
+        due |= 1 << i;
       }
     }
   } else if (now >= ext_clock_width) {
     gpio_clr_gpio_pin(B10);
   }
 
-  for (i = 0; i < 8; i++) {
-    n = output[i].now - output[i].effective.phase;
-    // print_dbg(" ");
-    // print_dbg_ulong(output[i].now);
-    // print_dbg("|");
-    // print_dbg_ulong(n);
-
-    // print_dbg("\r\n|  n: ");
-    // print_dbg_hex(n);
-
-    if (n < 0) {
-      n = output[i].effective.period + n;
-      // print_dbg(" warp: ");
-      // print_dbg_ulong(n);
-      // wrapped = true;
+  if (reschedule) {
+    due |= reschedule;
+    reschedule = 0;
+  }
+
+  // only outputs with an edge on this tick need to be touched
+  if (ticks == next_due) {
+    for (i = 0; i < 8; i++) {
+      if (output[i].next_edge == ticks) {
+        due |= 1 << i;
+      }
     }
+  }
 
-    if (!output[i].fired && (n < output[i].effective.width)) {
-      // print_dbg("+");
-      // print_dbg_ulong(n);
-      set_tr(i);
-      output[i].fired = true;
-    } else if (output[i].fired && (n >= output[i].effective.width)) {
-      // print_dbg("-");
-      // print_dbg_ulong(n);
-      clr_tr(i);
-      output[i].fired = false;
+  if (due) {
+    for (i = 0; i < 8; i++) {
+      if (due & (1 << i)) {
+        sync_output(&output[i]);
+        update_output(i, &set, &clr);
+      }
     }
 
-    output[i].now++;
-    if (output[i].now >= output[i].effective.period) {
-      // print_dbg("\r\n| wrap: ");
-      // print_dbg_ulong(output[i].now);
-      output[i].now = 0;
+    next_due = output[0].next_edge;
+    for (i = 1; i < 8; i++) {
+      if ((s32)(output[i].next_edge - next_due) < 0) {
+        next_due = output[i].next_edge;
+      }
     }
+
+    // all edges due on this tick land together
+    set_tr_mask(set, clr);
   }
+
+  ticks++;
+
+  PROFILE_END(profile_tick);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -557,11 +664,11 @@ void keytimer_arc(void) {
 }
 
 void default_arc(void) {
-  flashc_memset16((void *)&(f.arc_state.clock_rate), 640, 2, true);
+  flashc_memset32((void *)&(f.arc_state.bpm), BPM_DEFAULT, 4, true);
 }
 
 void write_arc(void) {
-  flashc_memset16((void *)&(f.arc_state.clock_rate), arc_state.clock_rate, 2, true);
+  flashc_memset32((void *)&(f.arc_state.bpm), arc_state.bpm, 4, true);
 }
 
 void read_arc(void) {
@@ -601,11 +708,29 @@ void resume_arc(void) {
   if (fresh) {
     init_arc();
     fresh = false;
-  } else {
-    // more to do?
-    monomeFrameDirty++;
   }
+
+  // levels never reach 0xff so the next refresh sends both rings
+  memset(ring_shadow, 0xff, sizeof(ring_shadow));
+  mark_dirty(RING_ALL);
 }
 
 void ii_arc(uint8_t *d, uint8_t l) {
 }
+
+void arc_set_bpm(fix16_t bpm) {
+  u8 flags = irqs_pause();
+  tempo_set_bpm(&tempo, bpm);
+  arc_state.bpm = tempo.bpm;
+  phasor_hz = tempo_next_hz(&tempo);
+  phasor_set_frequency(phasor_hz);
+  irqs_resume(flags);
+}
+
+fix16_t arc_get_bpm(void) {
+  return arc_state.bpm;
+}
+
+static u16 arc_bpm_quarters(void) {
+  return arc_state.bpm >> 14;
+}
@@ -1,8 +1,10 @@
 #pragma once
 
+#include "libfixmath/fix16.h"
+
 // arc mode values saved to nvram
 typedef struct {
-  u16 clock_rate;
+  fix16_t bpm;
 } arc_state_t;
 
 void enter_mode_arc(void);
@@ -15,3 +17,5 @@ void init_arc(void);
 void resume_arc(void);
 void clock_arc(uint8_t phase);
 void ii_arc(uint8_t *d, uint8_t l);
+void arc_set_bpm(fix16_t bpm);
+fix16_t arc_get_bpm(void);
@@ -6,10 +6,34 @@
 
 #include "mode_common.h"
 
-u16 calc_clock_frequency(u16 rate) {
-  // assumes rate [8-1280]
-  if (rate < 8) {
-    rate = 8;
+fix16_t clamp_bpm(fix16_t bpm) {
+  if (bpm < BPM_MIN) {
+    return BPM_MIN;
   }
-  return rate; // 8hz - 1288hz
+  if (bpm > BPM_MAX) {
+    return BPM_MAX;
+  }
+  return bpm;
+}
+
+void tempo_set_bpm(tempo_t *t, fix16_t bpm) {
+  t->bpm = clamp_bpm(bpm);
+
+  // phasor rate in 16.16 hz
+  u32 rate = ((u64)t->bpm * TICKS_PER_BEAT + 30) / 60;
+  u32 frac = rate & 0xffff;
+  t->hz = rate >> 16;
+
+  // a cycle at hz + 1 is shorter than one at the tempo by the same proportion
+  // as one at hz is longer, which weighs the share toward hz + 1 slightly more
+  // than the fractional rate alone
+  t->share = frac ? ((((u64)frac * (t->hz + 1)) << 16) / rate) : 0;
+  t->carry = 0;
+}
+
+// rate for the next phasor cycle, called at the start of each cycle
+u16 tempo_next_hz(tempo_t *t) {
+  u32 carry = (u32)t->carry + t->share;
+  t->carry = carry;
+  return t->hz + (carry >> 16);
 }
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include "libfixmath/fix16.h"
 #include "types.h"
 
 // brightness constants
@@ -25,9 +26,31 @@
 
 #define MAX_DIVISOR 16
 
-#define MAX_PHASOR_HZ 1280
+// key timer ticks (50ms) a mode waits after a change before writing flash
+#define SAVE_DELAY 40
 
 #define GRID_WIDTH 16
 #define GRID_HEIGHT 8
 
-u16 calc_clock_frequency(u16 rate);
+// tempo is kept as 16.16 fixed point bpm, a phasor cycle is a sixteenth.
+// at BPM_MIN the phasor runs at 21 hz, so the cycles either side of a tempo
+// between two whole hz rates differ by under 5%.
+#define CYCLES_PER_BEAT 4
+#define TICKS_PER_BEAT (PPQ * CYCLES_PER_BEAT)
+#define BPM_MIN F16(5)
+#define BPM_MAX F16(600)
+#define BPM_DEFAULT F16(150)
+
+// the phasor runs at whole hz, tempos between two rates are reached by
+// switching between them each cycle in the proportion which averages out to
+// the exact cycle length
+typedef struct {
+  fix16_t bpm;
+  u16 hz;    // rate at or below the tempo
+  u16 share; // fraction (of 0x10000) of cycles to run at hz + 1
+  u16 carry;
+} tempo_t;
+
+fix16_t clamp_bpm(fix16_t bpm);
+void tempo_set_bpm(tempo_t *t, fix16_t bpm);
+u16 tempo_next_hz(tempo_t *t);
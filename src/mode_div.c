@@ -1,15 +1,25 @@
 // asf
+#include "conf_board.h"
+#include "cycle_counter.h"
 #include "gpio.h"
 #include "print_funcs.h"
+#include "string.h"
 
 // libavr32
 #include "events.h"
 #include "flashc.h"
 #include "i2c.h"
+#include "interrupts.h"
+#include "phasor.h"
+#include "util.h"
 
 // this
+#include "clock_follow.h"
 #include "main.h"
+#include "mode_common.h"
 #include "mode_div.h"
+#include "period_table.h"
+#include "profile.h"
 
 //------------------------------
 //------ prototypes
@@ -21,17 +31,45 @@ static void handler_DivFrontShort(s32 data);
 static void handler_DivFrontLong(s32 data);
 static void handler_DivClockExt(s32 data);
 static void handler_DivClockNormal(s32 data);
+static void handler_DivPollADC(s32 data);
 
-static void pulse_div(uint8_t phase);
+static void process_div(u8 now, bool reset);
+static u16 div_clock_input(u8 level);
+static void start_div_clock(void);
 static void reset_div(void);
+static void build_div_cycle(void);
 
 //-----------------------------
 //----- globals
 
+// lcm(1..8), enough to cover the default divisors
+#define DIV_CYCLE_MAX 840
+
 // copy of nvram state for editing
 static div_state_t div_state;
-static u8 div_value[8];
-static u8 div_counter[8];
+
+// gate mask for each clock of the full divider cycle, the cycle is the least
+// common multiple of the divisors. when that is too long for the table
+// (div_cycle_length == 0) the mask is built from per output counters instead.
+// a new table is built in the buffer the phasor isn't reading.
+static u8 div_cycle_buf[2][DIV_CYCLE_MAX];
+static u8 *div_cycle = div_cycle_buf[0];
+static u16 div_cycle_length;
+static u16 div_cycle_pos;
+static u8 div_counter[DIV_NUM_OUTPUTS];
+
+// outputs are raised at their phase within the clock they pulse on and fall
+// width ticks later, which may be several clocks on
+static u16 div_tick;                  // free running phasor tick count
+static u16 div_fall[DIV_NUM_OUTPUTS]; // tick each high output falls on
+static u8 div_rising;                 // outputs still to rise in the current clock
+static u8 div_high;                   // outputs which are high
+
+static u8 save_timer; // key timer ticks until div_state is written, 0 if saved
+
+static tempo_t tempo;  // internal clock
+static u16 phasor_hz; // rate the phasor was last set to from the tempo
+static follow_t follow;
 
 typedef struct {
   u8 playing : 1;
@@ -44,16 +82,14 @@ static div_run_state_t div_run_state;
 
 void enter_mode_div(void) {
   print_dbg("\r\n> mode div");
-  div_state = f.div_state;
 
   init_div();
 
-  app_event_handlers[kEventPollADC] = &handler_PollADC; // from main
+  app_event_handlers[kEventPollADC] = &handler_DivPollADC;
   app_event_handlers[kEventClockExt] = &handler_DivClockExt;
   app_event_handlers[kEventClockNormal] = &handler_DivClockNormal;
 
-  clock = &clock_div;
-  clock_set(div_state.clock_period);
+  clock_input = &div_clock_input;
 
   process_ii = &ii_div;
 
@@ -61,9 +97,25 @@ void enter_mode_div(void) {
     app_event_handlers[kEventFrontShort] = &handler_DivFrontShort;
     app_event_handlers[kEventFrontLong] = &handler_DivFrontLong;
   }
+
+  follow_init(&follow);
+  tempo_set_bpm(&tempo, div_state.bpm);
+  phasor_hz = tempo_next_hz(&tempo);
+  phasor_set_callback(&process_div);
+  phasor_setup(phasor_hz, PPQ);
+  phasor_start();
 }
 
 void leave_mode_div(void) {
+  if (save_timer) {
+    save_timer = 0;
+    write_div();
+  }
+  phasor_stop();
+  phasor_set_callback(NULL);
+  clr_tr_all();
+  div_high = 0;
+  div_rising = 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -100,53 +152,183 @@ void handler_DivFrontLong(s32 data) {
 }
 
 void handler_DivClockExt(s32 data) {
-  if (external_clock) {
-    pulse_div(data);
+  if (!external_clock || !clock_edge(data)->level) {
+    return;
+  }
+
+  // each pulse starts a clock (see div_clock_input), the rate only sets how
+  // fast the ticks within it (widths and phases) run
+  u16 hz = follow_rate(&follow, clock_edge(data)->time, PPQ, FMCK_HZ);
+  if (hz) {
+    u8 flags = irqs_pause();
+    phasor_set_frequency(hz);
+    irqs_resume(flags);
   }
 }
 
 void handler_DivClockNormal(s32 data) {
   external_clock = data != 0;
+  follow_init(&follow);
 
   // automatically toggle play mode on when a jack is inserted
+  u8 flags = irqs_pause();
   if (external_clock) {
     div_run_state.playing = true;
     reset_div();
     clr_tr_all();
+    div_high = 0;
+    div_rising = 0;
     gpio_clr_gpio_pin(B10);
+  } else {
+    phasor_hz = tempo_next_hz(&tempo);
+    phasor_set_frequency(phasor_hz);
   }
+  irqs_resume(flags);
+}
+
+void handler_DivPollADC(s32 data) {
+  static u16 last_poll = 10000;
+  u16 i = poll_knob() >> 2;
+
+  if (i != last_poll) {
+    div_set_bpm(period_bpm[i]);
+  }
+
+  last_poll = i;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 ///// mode
 
 void keytimer_div(void) {
+  // a script may stream changes, flash is written once they stop
+  if (save_timer && --save_timer == 0) {
+    write_div();
+  }
 }
 
 void default_div(void) {
-  flashc_memset32((void *)&(f.div_state.clock_period), 100, 4, true);
+  flashc_memset32((void *)&(f.div_state.bpm), BPM_DEFAULT, 4, true);
+  for (u8 i = 0; i < DIV_NUM_OUTPUTS; i++) {
+    flashc_memset8((void *)&(f.div_state.divisor[i]), i + 1, 1, true);
+  }
+  flashc_memset8((void *)f.div_state.offset, 0, DIV_NUM_OUTPUTS, true);
+  flashc_memset8((void *)f.div_state.width, PPQ >> 1, DIV_NUM_OUTPUTS, true);
+  flashc_memset8((void *)f.div_state.phase, 0, DIV_NUM_OUTPUTS, true);
 }
 
 void write_div(void) {
-  flashc_memset32((void *)&(f.div_state.clock_period), div_state.clock_period, 4, true);
+  flashc_memcpy((void *)&f.div_state, &div_state, sizeof(div_state), true);
 }
 
 void read_div(void) {
+  div_state = f.div_state;
+}
+
+static u16 gcd(u16 a, u16 b) {
+  while (b) {
+    u16 t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+static void build_div_cycle(void) {
+  u16 length = 1;
+  u8 i;
+
+  for (i = 0; i < DIV_NUM_OUTPUTS; i++) {
+    div_state.divisor[i] = uclip(div_state.divisor[i], 1, DIV_DIVISOR_MAX);
+    div_state.offset[i] %= div_state.divisor[i];
+    div_state.width[i] = uclip(div_state.width[i], 1, 0xff);
+    div_state.phase[i] %= PPQ;
+    if (length) {
+      length = length / gcd(length, div_state.divisor[i]) * div_state.divisor[i];
+      if (length > DIV_CYCLE_MAX) {
+        length = 0;
+      }
+    }
+  }
+
+  // the clock runs from the phasor interrupt, the table is built where it
+  // can't see it and swapped in
+  u8 *cycle = div_cycle == div_cycle_buf[0] ? div_cycle_buf[1] : div_cycle_buf[0];
+  if (length) {
+    memset(cycle, 0, length);
+    for (i = 0; i < DIV_NUM_OUTPUTS; i++) {
+      for (u16 k = div_state.offset[i]; k < length; k += div_state.divisor[i]) {
+        cycle[k] |= 1 << i;
+      }
+    }
+  }
+
+  u8 flags = irqs_pause();
+  div_cycle = cycle;
+  div_cycle_length = length;
+  div_cycle_pos = 0;
+  for (i = 0; i < DIV_NUM_OUTPUTS; i++) {
+    div_counter[i] = div_state.offset[i];
+  }
+  irqs_resume(flags);
 }
 
 void reset_div(void) {
-  for (u8 i = 0; i < 8; i++) {
-    div_counter[i] = div_value[i] = i + 1;
+  div_cycle_pos = 0;
+  for (u8 i = 0; i < DIV_NUM_OUTPUTS; i++) {
+    div_counter[i] = div_state.offset[i];
+  }
+}
+
+// values are checked before they are stored, the phasor interrupt reads them
+void div_set_output(uint8_t n, uint8_t divisor, uint8_t offset) {
+  if (n >= DIV_NUM_OUTPUTS) {
+    return;
+  }
+  divisor = uclip(divisor, 1, DIV_DIVISOR_MAX);
+  u8 flags = irqs_pause();
+  div_state.divisor[n] = divisor;
+  div_state.offset[n] = offset % divisor;
+  irqs_resume(flags);
+  build_div_cycle();
+  save_timer = SAVE_DELAY;
+}
+
+void div_set_gate(uint8_t n, uint8_t width, uint8_t phase) {
+  if (n >= DIV_NUM_OUTPUTS) {
+    return;
   }
+  u8 flags = irqs_pause();
+  div_state.width[n] = uclip(width, 1, 0xff);
+  div_state.phase[n] = phase % PPQ;
+  irqs_resume(flags);
+  save_timer = SAVE_DELAY;
+}
+
+void div_set_bpm(fix16_t bpm) {
+  u8 flags = irqs_pause();
+  tempo_set_bpm(&tempo, bpm);
+  div_state.bpm = tempo.bpm;
+  if (!external_clock) {
+    phasor_hz = tempo_next_hz(&tempo);
+    phasor_set_frequency(phasor_hz);
+  }
+  irqs_resume(flags);
+}
+
+fix16_t div_get_bpm(void) {
+  return div_state.bpm;
 }
 
 void init_div(void) {
+  read_div();
+  build_div_cycle();
+
   div_run_state.playing = false;
   div_run_state.should_transition = false;
   div_run_state.should_reset = false;
   div_run_state.ignore_next_short = false;
 
-  reset_div();
   clr_tr_all();
   // weirdly the clock output ends up in a half high state on power up, clear it
   // here to minimize the chance of partly triggering downstream modules
@@ -156,50 +338,132 @@ void init_div(void) {
 void resume_div(void) {
 }
 
-void clock_div(uint8_t phase) {
-  if (!external_clock) {
-    pulse_div(phase);
+// gate mask for the current clock when the cycle is too long for the table.
+// counters hold the clocks remaining until each output's next pulse.
+static u8 div_counter_mask(void) {
+  u8 mask = 0;
+  for (u8 i = 0; i < DIV_NUM_OUTPUTS; i++) {
+    if (div_counter[i] == 0) {
+      mask |= 1 << i;
+    }
   }
+  return mask;
 }
 
-void pulse_div(uint8_t phase) {
-  u8 i;
+static void div_counter_advance(void) {
+  for (u8 i = 0; i < DIV_NUM_OUTPUTS; i++) {
+    if (div_counter[i] == 0) {
+      div_counter[i] = div_state.divisor[i];
+    }
+    div_counter[i]--;
+  }
+}
+
+// gate length of an output in ticks, kept short of its next pulse
+static u16 div_width(u8 i) {
+  u16 limit = div_state.divisor[i] * PPQ - 1;
+  return div_state.width[i] < limit ? div_state.width[i] : limit;
+}
+
+static void start_div_clock(void) {
+  // check to see if we need to pause
+  if (div_run_state.should_transition) {
+    div_run_state.playing = false;
+    div_run_state.should_transition = false;
+  }
 
   if (!div_run_state.playing)
     return;
 
-  if (phase) {
-    gpio_set_gpio_pin(B10);
+  gpio_set_gpio_pin(B10);
+
+  if (div_run_state.should_reset) {
+    reset_div();
+    div_run_state.should_reset = false;
+  }
 
-    if (div_run_state.should_reset) {
-      reset_div();
-      div_run_state.should_reset = false;
+  if (div_cycle_length) {
+    div_rising = div_cycle[div_cycle_pos];
+    if (++div_cycle_pos == div_cycle_length) {
+      div_cycle_pos = 0;
     }
+  } else {
+    div_rising = div_counter_mask();
+    div_counter_advance();
+  }
+}
+
+// called from the clock input interrupt so a clock starts on the next tick
+static u16 div_clock_input(u8 level) {
+  if (level && external_clock) {
+    phasor_reset();
+  }
+  return div_tick;
+}
 
-    for (i = 0; i < 8; i++) {
-      if (div_counter[i] == div_value[i]) {
-        set_tr(i);
+static void process_div(u8 now, bool reset) {
+  u8 set = 0, clr = 0;
+
+  PROFILE_BEGIN();
+
+  div_tick++;
+
+  // with an external clock the phasor is reset by each pulse, a clock only
+  // starts there so a phasor running a little fast doesn't add one
+  if (now == MIN_PHASE && (reset || !external_clock)) {
+    if (!external_clock) {
+      // switch between the whole hz rates either side of the tempo
+      u16 hz = tempo_next_hz(&tempo);
+      if (hz != phasor_hz) {
+        phasor_hz = hz;
+        phasor_set_frequency(hz);
       }
     }
-  } else {
+    start_div_clock();
+  } else if (now == (PPQ >> 1)) {
     gpio_clr_gpio_pin(B10);
-    for (i = 0; i < 8; i++) {
-      if (div_counter[i] <= div_value[i]) {
-        clr_tr(i);
-      }
+  }
 
-      div_counter[i]--;
-      if (div_counter[i] == 0) {
-        div_counter[i] = div_value[i];
+  if (div_rising | div_high) {
+    for (u8 i = 0; i < DIV_NUM_OUTPUTS; i++) {
+      u8 bit = 1 << i;
+      if ((div_high & bit) && div_fall[i] == div_tick) {
+        clr |= bit;
+      }
+      if ((div_rising & bit) && div_state.phase[i] == now) {
+        set |= bit;
+        div_fall[i] = div_tick + div_width(i);
       }
     }
-    // check to see if we need to pause
-    if (div_run_state.playing && div_run_state.should_transition) {
-      div_run_state.playing = false;
-      div_run_state.should_transition = false;
-    }
+    div_rising &= ~set;
+    div_high = (div_high & ~clr) | set;
+    set_tr_mask(set, clr & ~set);
   }
+
+  PROFILE_END(profile_div);
 }
 
 void ii_div(uint8_t *d, uint8_t l) {
+  if (l < 1) {
+    return;
+  }
+
+  switch (d[0]) {
+  case II_DIV_GATE:
+    if (l > 3) {
+      div_set_gate(d[1], d[2], d[3]);
+      print_dbg("\r\n div: gate ");
+      print_dbg_ulong(d[1]);
+    }
+    break;
+  case II_DIV_OUTPUT:
+    if (l > 3) {
+      div_set_output(d[1], d[2], d[3]);
+      print_dbg("\r\n div: output ");
+      print_dbg_ulong(d[1]);
+    }
+    break;
+  default:
+    break;
+  }
 }
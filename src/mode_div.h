@@ -1,10 +1,25 @@
 #pragma once
 
-// arc mode values saved to nvram
+#include "libfixmath/fix16.h"
+
+#define DIV_NUM_OUTPUTS 8
+#define DIV_DIVISOR_MAX 16
+
+// div mode values saved to nvram. the clock is a phasor cycle, widths and
+// phases are in phasor ticks (PPQ per clock).
 typedef struct {
-  uint32_t clock_period;
+  fix16_t bpm;                      // internal clock tempo
+  uint8_t divisor[DIV_NUM_OUTPUTS]; // clocks per output pulse [1-DIV_DIVISOR_MAX]
+  uint8_t offset[DIV_NUM_OUTPUTS];  // clocks the output pulse is delayed by [0-divisor)
+  uint8_t width[DIV_NUM_OUTPUTS];   // ticks the output pulse is high for, at most divisor clocks
+  uint8_t phase[DIV_NUM_OUTPUTS];   // ticks into its clock the output pulse rises [0-PPQ)
 } div_state_t;
 
+// ii ops, laid out as the grid ops are (see mode_grid.h). outputs are
+// numbered from 0.
+#define II_DIV_GATE 0x10   // output, width, phase, saved
+#define II_DIV_OUTPUT 0x11 // output, divisor, offset, saved
+
 void enter_mode_div(void);
 void leave_mode_div(void);
 
@@ -13,5 +28,8 @@ void keytimer_div(void);
 void default_div(void);
 void init_div(void);
 void resume_div(void);
-void clock_div(uint8_t phase);
+void div_set_output(uint8_t n, uint8_t divisor, uint8_t offset);
+void div_set_gate(uint8_t n, uint8_t width, uint8_t phase);
+void div_set_bpm(fix16_t bpm);
+fix16_t div_get_bpm(void);
 void ii_div(uint8_t *d, uint8_t l);
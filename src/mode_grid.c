@@ -5,52 +5,76 @@
 //
 
 // asf
+#include "conf_board.h"
+#include "cycle_counter.h"
 #include "gpio.h"
 #include "print_funcs.h"
 #include "string.h"
 
 // libavr32
-#include "adc.h"
 #include "events.h"
 #include "flashc.h"
 #include "i2c.h"
+#include "interrupts.h"
 #include "monome.h"
 #include "phasor.h"
 #include "util.h"
 
 // this
+#include "clock_follow.h"
 #include "main.h"
 #include "mode_common.h"
 #include "mode_grid.h"
 #include "playhead.h"
+#include "profile.h"
+#include "schedule.h"
+#include "tap_tempo.h"
 #include "track.h"
 
-#define GRID_WAVE_EDGES 8
 #define GRID_NUM_OUTPUTS 8
+#define GRID_NUM_EVENTS PPQ // at most one event per tick, edges on the same tick are merged
+#define GRID_NO_EVENT 0xff
+#define GRID_NUM_VOICES (GRID_NUM_TRACKS * VOICE_COUNT)
+// worst case for an output is a ratchet which runs into the next step
+// overlapping a full ratchet on that step
+#define GRID_NUM_GATES (GRID_NUM_VOICES * RATCHET_MAX * 2)
+#define GRID_NO_GATE 0xff
+
+#define GRID_DEFAULT_SEED 0x2545f491
+
+#define GRID_NUM_QUADRANTS 2 // 16x8, quadrant 0 is the left half and 1 the right
+#define GRID_QUADRANT_SIZE 8
+#define GRID_LED_BYTES (GRID_NUM_QUADRANTS * GRID_QUADRANT_SIZE * GRID_QUADRANT_SIZE)
 
 #define TRACK1_DEFAULT_PATTERN 0
 #define TRACK2_DEFAULT_PATTERN 12
 
-#define CLOCK_HZ_MAX 2560
+#define GRID_KNOB_UNSET 0xffff
 
 //------------------------------
 //------ types
 
 typedef enum { uiEdit, uiLength, uiPattern } ui_mode_t;
 
-typedef union {
-  struct {
-    u16 set : 1;
-    u16 level : 1;
-    u16 offset : 14;
-  } f;
-  u16 v;
-} edge_t;
+typedef void (*key_handler_t)(u8 x, u8 y, u8 z); // x, y relative to the region
 
 typedef struct {
-  edge_t edges[GRID_WAVE_EDGES]; // offsets in phaser ramp where level transition should occur
-  u8 cursor;                     // index of next edge
-} waveform_t;
+  u8 x, y, w, h;
+  key_handler_t handler;
+} key_region_t;
+
+typedef struct {
+  u8 offset; // offset in phasor ramp where the transitions occur
+  u8 set;    // mask of outputs which go high
+  u8 clr;    // mask of outputs which go low
+} grid_event_t;
+
+typedef struct {
+  u16 rise; // ticks the gate starts and ends on, see step_tick
+  u16 fall;
+  u8 high;  // rise has already been loaded as an event
+  u8 next;  // following gate on the same output or GRID_NO_GATE
+} gate_t;
 
 typedef struct {
   u8 track;
@@ -77,42 +101,111 @@ static void handler_GridFrontLong(s32 data);
 static void handler_GridTr(s32 data);
 static void handler_GridTrNormal(s32 data);
 static void handler_GridPollADC(s32 data);
+static void handler_GridClockExt(s32 data);
+static void handler_GridClockNormal(s32 data);
 
 static void handler_GridKey(s32 data);
 static void handler_GridRefresh(s32 data);
 
 static void render_grid(void);
+static void render_playheads(void);
+static bool diff_quadrant(u8 q);
 static void render_nav(void);
 static void render_track_select(u8 x, u8 y);
 static void render_playhead_nudge(u8 x, u8 y);
 static void render_step_nudge(u8 x, u8 y);
+static void render_step_ratchet(u8 x, u8 y);
+static void render_fill(u8 x, u8 y);
 static void render_cue_mode(u8 x, u8 y, cue_mode_t mode);
 static void render_pattern_area(u8 x, u8 y);
 static void render_meta_area(u8 x, u8 y);
 static void render_meta_buffer_bar(u8 x, u8 y);
 
 static void process_phasor(u8 now, bool reset);
-static void build_waves(void);
-
-static void handle_key_upper_step(u8 x, u8 y, u8 z);
-static void handle_key_upper_len(u8 x, u8 y, u8 z);
-static void handle_key_upper_pat(u8 x, u8 y, u8 z);
-static void handle_key_cue(u8 track_num, u8 x, u8 y, u8 z);
-static bool handle_key_control(u8 x, u8 y, u8 z);
+static u16 grid_clock_input(u8 level);
+static bool clock_following(void);
+static void resume_tempo(void);
+static void load_events(void);
+static void add_event(u8 wn, u8 offset, u8 level);
+static void init_gates(void);
+static bool add_gate(u8 wn, u16 rise, u16 fall);
+static void load_gates(u8 wn);
+static void update_schedules(void);
+
+static void set_ui_mode(ui_mode_t mode);
+static void key_steps(u8 x, u8 y, u8 z);
+static void key_length(u8 x, u8 y, u8 z);
+static void key_cue(u8 x, u8 y, u8 z);
+static void key_pattern(u8 x, u8 y, u8 z);
+static void key_meta(u8 x, u8 y, u8 z);
+static void key_meta_live(u8 x, u8 y, u8 z);
+static void key_select(u8 x, u8 y, u8 z);
+static void key_nav(u8 x, u8 y, u8 z);
+static void key_track_select(u8 x, u8 y, u8 z);
+static void key_playhead(u8 x, u8 y, u8 z);
+static void key_ratchet(u8 x, u8 y, u8 z);
+static void key_fill(u8 x, u8 y, u8 z);
+static void key_step_edit(u8 x, u8 y, u8 z);
 
 static void do_step_key(u8 tn, u8 x, u8 y, u8 z);
 static void do_len_key(track_view_t *v, u8 x, u8 y, u8 z);
 static void do_step_selection(u8 state);
 static void do_row_selection(u8 state);
 static void do_focused_step_timing(s8 direction);
+static void do_focused_step_length(s8 direction);
+static void do_focused_step_ratchet(u8 hits);
+static void do_focused_step_spacing(void);
 
-inline static u16 edge_pack(u8 level, u16 offset);
+//-----------------------------
+//----- key layouts
+
+// regions are listed per ui_mode and flattened into key_map whenever the
+// mode changes, later regions take precedence where they overlap
+
+// clang-format off
+static const key_region_t edit_regions[] = {
+  {0,  0, 16, 6, &key_steps},
+  {0,  6, 1,  2, &key_select},
+  {1,  6, 2,  2, &key_nav},
+  {3,  6, 3,  2, &key_playhead},
+  {6,  6, 4,  2, &key_ratchet},
+  {10, 6, 1,  2, &key_fill},
+  {11, 6, 5,  2, &key_step_edit},
+  {0,  0, 0,  0, NULL},
+};
+
+static const key_region_t length_regions[] = {
+  {0,  0, 16, 6, &key_length},
+  {0,  6, 1,  2, &key_select},
+  {1,  6, 2,  2, &key_nav},
+  {0,  0, 0,  0, NULL},
+};
+
+static const key_region_t pattern_regions[] = {
+  {0,  0, 4,  6, &key_cue},
+  {4,  0, 4,  6, &key_pattern},
+  {9,  0, 2,  6, &key_meta},
+  {12, 0, 1,  6, &key_meta_live},
+  {0,  6, 1,  2, &key_select},
+  {1,  6, 2,  2, &key_nav},
+  {4,  6, 1,  2, &key_track_select},
+  {0,  0, 0,  0, NULL},
+};
+// clang-format on
+
+static const key_region_t *const key_layouts[] = {
+    [uiEdit] = edit_regions,
+    [uiLength] = length_regions,
+    [uiPattern] = pattern_regions,
+};
 
 //-----------------------------
 //----- globals
 
 // runtime state
 static ui_mode_t ui_mode;
+static const key_region_t *key_regions;  // layout for the current ui_mode
+static u8 key_map[GRID_HEIGHT][GRID_WIDTH]; // 1 + index into key_regions, 0 if unused
 static track_view_t view[GRID_NUM_TRACKS];
 static playhead_t playhead[GRID_NUM_TRACKS];
 static live_cue_t live_cue[GRID_NUM_TRACKS] = { {0, 0}, {0, 0} };
@@ -120,14 +213,34 @@ static live_cue_t live_cue[GRID_NUM_TRACKS] = { {0, 0}, {0, 0} };
 static u8 step_selection = 0;
 static u8 row_selection = 0;
 static u8 track_selection[GRID_NUM_TRACKS] = {0, 0};
+static u8 fill[GRID_NUM_TRACKS] = {0, 0}; // held to play fill (and mute not fill) trigs
 static focused_step_t step_focus = {0, 0, 0, 0}; // FIXME: should changing pattern/meta clear this?
 
-static u16 clock_hz;
-static waveform_t waves[GRID_NUM_OUTPUTS];
-static edge_t carry[GRID_NUM_OUTPUTS]; // offset into next waveform of the trailing edge of the
-                                       // previous waveform
-
-static bool front_long = false;
+static tempo_t tempo;             // internal clock
+static u16 phasor_hz;             // rate the phasor was last set to from the tempo
+static follow_t follow;           // external clock tracking
+static tap_t tap;                 // front button tap tempo
+static volatile u16 phasor_tick;  // count of phasor ticks, a multiple of PPQ at each step
+static volatile bool reset_armed; // clock input asked for a reset, taken at a step start
+static u8 bar_step;               // steps since the start of the bar
+static schedule_t schedule[GRID_NUM_TRACKS];
+static grid_event_t events[GRID_NUM_EVENTS + 1]; // edges for all outputs sorted by offset
+static u8 event_count;
+static u8 next_event; // index of next event, the list is terminated by GRID_NO_EVENT
+static u8 tick_set[PPQ]; // per tick output masks gathered while loading the events
+static u8 tick_clr[PPQ];
+static u32 tick_used[PPQ / 32]; // ticks with masks to collect, msb first
+static u16 step_tick; // free running tick count at the start of the current step
+static gate_t gates[GRID_NUM_GATES]; // pool of gates which have yet to be loaded as events
+static u8 free_gate;                 // head of the unused gates
+static u8 pending[GRID_NUM_OUTPUTS]; // head of each output's gates, ordered by tick
+static u16 dropped_gates;            // ratchet hits lost to an exhausted pool
+
+static u8 led_shadow[GRID_LED_BYTES]; // levels last sent to the grid
+static u8 led_static[GRID_LED_BYTES]; // everything but the playheads
+static bool static_dirty;             // led_static needs to be rendered again
+static volatile bool playheads_moved; // set by the phasor interrupt, a frame is due
+static u8 save_timer;                 // key timer ticks until write_grid, 0 if saved
 
 // copy of nvram state for editing
 static global_t g;
@@ -140,14 +253,16 @@ void enter_mode_grid(void) {
   app_event_handlers[kEventTr] = &handler_GridTr;
   app_event_handlers[kEventTrNormal] = &handler_GridTrNormal;
   app_event_handlers[kEventPollADC] = &handler_GridPollADC;
+  app_event_handlers[kEventClockExt] = &handler_GridClockExt;
+  app_event_handlers[kEventClockNormal] = &handler_GridClockNormal;
   app_event_handlers[kEventMonomeGridKey] = &handler_GridKey;
   app_event_handlers[kEventMonomeRefresh] = &handler_GridRefresh;
 
-  ui_mode = uiEdit;
+  set_ui_mode(uiEdit);
 
   resume_grid();
 
-  clock = &clock_null;
+  clock_input = &grid_clock_input;
 
   process_ii = &ii_grid;
 
@@ -156,16 +271,25 @@ void enter_mode_grid(void) {
     app_event_handlers[kEventFrontLong] = &handler_GridFrontLong;
   }
 
-  clock_hz = calc_clock_frequency(g.clock_rate);
-  print_dbg("\r\n clock_hz = ");
-  print_dbg_ulong(clock_hz);
+  follow_init(&follow);
+  tap_init(&tap);
+  reset_armed = false;
+  bar_step = 0;
+  tempo_set_bpm(&tempo, g.bpm);
+  phasor_hz = tempo_next_hz(&tempo);
+  print_dbg("\r\n bpm = ");
+  print_dbg_ulong(fix16_to_int(tempo.bpm));
   phasor_set_callback(&process_phasor);
-  phasor_setup(clock_hz, PPQ);
+  phasor_setup(phasor_hz, PPQ);
   phasor_start();
 }
 
 void leave_mode_grid(void) {
   print_dbg("\r\n leave mode grid");
+  if (save_timer) {
+    save_timer = 0;
+    write_grid();
+  }
   phasor_stop();
   phasor_set_callback(NULL);
 }
@@ -174,17 +298,23 @@ void leave_mode_grid(void) {
 ///// handlers
 
 void handler_GridFrontShort(s32 data) {
-  print_dbg("\r\n grid: front short ");
-  print_dbg_ulong(data);
-  if (front_long) {
-    front_long = false;
+  // taps set the tempo, the press time is taken from the interrupt. the
+  // phasor only changes speed so the playheads keep their place.
+  if (clock_following()) {
+    return;
+  }
+
+  u32 period = tap_press(&tap, front_press_time(), FMCK_HZ);
+  if (period) {
+    grid_set_bpm(clamp_bpm((fix16_t)(((u64)60 * FMCK_HZ << 16) / period)));
+    print_dbg("\r\n grid: tap bpm = ");
+    print_dbg_ulong(fix16_to_int(g.bpm));
   }
 }
 
 void handler_GridFrontLong(s32 data) {
   print_dbg("\r\n grid: front long ");
   print_dbg_ulong(data);
-  front_long = true;
 }
 
 void handler_GridTr(s32 data) {
@@ -197,50 +327,78 @@ void handler_GridTrNormal(s32 data) {
   print_dbg_ulong(data);
 }
 
-void handler_GridPollADC(s32 data) {
-  static u16 last_poll = 10000;
-  u16 i, clock_time;
+void handler_GridClockExt(s32 data) {
+  const clock_edge_t *e = clock_edge(data);
+  if (!e->level || !clock_following()) {
+    return;
+  }
+
+  // the pulse is measured from where the interrupt took it, not from when the
+  // main loop got to it
+  u16 hz = follow_pulse(&follow, e->time, e->tick, g.clock_steps * PPQ, FMCK_HZ);
+  if (hz) {
+    u8 flags = irqs_pause();
+    phasor_set_frequency(hz);
+    irqs_resume(flags);
+  }
+}
 
-  // the ADC seems very noisy, avoid constant jitter by only adjusting clock
-  // with the front button is held
-  if (front_long) {
-    adc_convert(&adc);
+void handler_GridClockNormal(s32 data) {
+  external_clock = data != 0;
+  follow_init(&follow);
+  if (!clock_following()) {
+    resume_tempo();
+  }
+}
 
-    i = adc[0]; // [0-4096]
-    i = i >> 3; // [0-512]
+void handler_GridPollADC(s32 data) {
+  static u16 last_poll = GRID_KNOB_UNSET;
+  u16 i;
 
-    if (i != last_poll) {
-      print_dbg("\r\n raw = ");
-      print_dbg_ulong(i);
-      print_dbg(" ");
-      print_dbg_ulong(adc[0]);
-      clock_time = CLOCK_HZ_MAX * i / 512;
-      g.clock_rate = clock_hz = calc_clock_frequency(clock_time);
-      print_dbg("\r\n clock_hz = ");
-      print_dbg_ulong(clock_hz);
-      phasor_set_frequency(clock_hz);
-    }
+  i = poll_knob() >> 3; // [0-512]
 
-    last_poll = i;
+  // the first reading only records where the knob is, the saved rate holds
+  // until the knob is turned. the external clock sets the rate when patched.
+  if (last_poll != GRID_KNOB_UNSET && i != last_poll && !clock_following()) {
+    grid_set_bpm(BPM_MIN + (fix16_t)(((u64)(BPM_MAX - BPM_MIN) * i) >> 9));
+    print_dbg("\r\n bpm = ");
+    print_dbg_ulong(fix16_to_int(g.bpm));
   }
+
+  last_poll = i;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 ///// mode
 
 void keytimer_grid(void) {
+  static u16 last_dropped = 0;
+
   if (step_focus.hold_count > 0) {
     step_focus.hold_count--;
     // print_dbg("\r\n kt = ");
     // print_dbg_ulong(step_focus.hold_count);
   }
+
+  // ii may stream changes, flash is written once they stop
+  if (save_timer && --save_timer == 0) {
+    write_grid();
+  }
+
+  if (dropped_gates != last_dropped) {
+    last_dropped = dropped_gates;
+    print_dbg("\r\n grid: dropped gates = ");
+    print_dbg_ulong(last_dropped);
+  }
 }
 
 void default_grid(void) {
   print_dbg("\r\ndefault_grid()");
   print_dbg("\r\n defaulting globals");
-  flashc_memset16((void *)&(f.grid_state.g.clock_rate), 640, 2, true);
+  flashc_memset32((void *)&(f.grid_state.g.bpm), BPM_DEFAULT, 4, true);
   flashc_memset8((void *)&(f.grid_state.g.preset), 0, 1, true);
+  flashc_memset8((void *)&(f.grid_state.g.clock_steps), 1, 1, true);
+  flashc_memset8((void *)&(f.grid_state.g.reset_mode), resetOff, 1, true);
 
   // use the working preset to create the default preset
   print_dbg("\r\n defaulting presets");
@@ -252,7 +410,6 @@ void default_grid(void) {
   for (u8 i = 0; i < GRID_NUM_META; i++) {
     meta_init(&p.meta[i]);
   }
-  p.clock_rate = 640;
 
   // copy the default preset to each slot
   for (u8 i = 0; i < GRID_NUM_PRESETS; i++) {
@@ -264,8 +421,10 @@ void default_grid(void) {
 
 void write_grid(void) {
   print_dbg("\r\nwrite_grid()");
-  flashc_memset16((void *)&(f.grid_state.g.clock_rate), g.clock_rate, 2, true);
+  flashc_memset32((void *)&(f.grid_state.g.bpm), g.bpm, 4, true);
   flashc_memset8((void *)&(f.grid_state.g.preset), g.preset, 1, true);
+  flashc_memset8((void *)&(f.grid_state.g.clock_steps), g.clock_steps, 1, true);
+  flashc_memset8((void *)&(f.grid_state.g.reset_mode), g.reset_mode, 1, true);
   flashc_memcpy((void *)&f.grid_state.p[g.preset], &p, sizeof(p), true);
 }
 
@@ -274,6 +433,8 @@ void read_grid(void) {
   print_dbg("\r\nread_grid()");
   g = f.grid_state.g;           // restore saved globals
   p = f.grid_state.p[g.preset]; // restore selected preset
+  grid_set_clock_steps(g.clock_steps);
+  grid_set_reset_mode(g.reset_mode);
 }
 
 void init_grid(void) {
@@ -281,23 +442,148 @@ void init_grid(void) {
   print_dbg("\r\ninit_grid()");
   g = f.grid_state.g;           // restore saved globals
   p = f.grid_state.p[g.preset]; // restore selected preset
+  grid_set_clock_steps(g.clock_steps);
+  grid_set_reset_mode(g.reset_mode);
 }
 
 void resume_grid(void) {
   // called when entering mode after read_grid
   print_dbg("\r\nresume_grid()");
   // clear all because waveform transition logic is based tr state
+  u8 flags = irqs_pause();
   clr_tr_all();
+  init_gates();
+  irqs_resume(flags);
 
   playhead_init(&playhead[0]);
   playhead_init(&playhead[1]);
   track_view_init(&view[0], &p.track[0], &playhead[0], p.pattern);
   track_view_init(&view[1], &p.track[1], &playhead[1], p.pattern);
 
+  schedule_init(&schedule[0]);
+  schedule_init(&schedule[1]);
+  grid_seed(GRID_DEFAULT_SEED);
+  update_schedules();
+
+  // levels never reach 0xff so the first refresh sends every quadrant
+  memset(led_shadow, 0xff, sizeof(led_shadow));
+  static_dirty = true;
   monomeFrameDirty++;
 }
 
 void ii_grid(uint8_t *d, uint8_t l) {
+  if (l < 1) {
+    return;
+  }
+
+  switch (d[0]) {
+  case II_GRID_RESET_MODE:
+    if (l > 1) {
+      grid_set_reset_mode(d[1]);
+      if (external_clock && g.reset_mode != resetOff) {
+        // the input stops clocking and becomes a reset
+        resume_tempo();
+      }
+      save_timer = SAVE_DELAY;
+      print_dbg("\r\n grid: reset mode = ");
+      print_dbg_ulong(g.reset_mode);
+    }
+    break;
+  case II_GRID_CLOCK_STEPS:
+    if (l > 1) {
+      grid_set_clock_steps(d[1]);
+      // the intervals held were for the old pulse length
+      follow_init(&follow);
+      save_timer = SAVE_DELAY;
+      print_dbg("\r\n grid: clock steps = ");
+      print_dbg_ulong(g.clock_steps);
+    }
+    break;
+  case II_GRID_GROOVE:
+    if (l > 3) {
+      grid_set_groove(d[1], d[2], (s8)d[3]);
+      print_dbg("\r\n grid: groove ");
+      print_dbg_ulong(d[2]);
+    }
+    break;
+  case II_GRID_CONDITION:
+    if (l > 5) {
+      grid_set_condition(d[1], d[2], d[3], d[4], d[5]);
+      print_dbg("\r\n grid: condition ");
+      print_dbg_ulong(d[4]);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+void grid_set_groove(u8 track, u8 groove, s8 swing) {
+  if (track >= GRID_NUM_TRACKS || groove >= GROOVE_COUNT) {
+    return;
+  }
+  p.track[track].groove = groove;
+  p.track[track].swing = sclip(swing, 0, MID_PHASE);
+  // timing is folded into the schedule, the change lands on the next step
+  update_schedules();
+}
+
+void grid_set_condition(u8 track, u8 step, u8 voice, u8 condition, u8 arg) {
+  if (track >= GRID_NUM_TRACKS || step >= PATTERN_STEP_MAX || voice >= VOICE_COUNT ||
+      condition > condFill || arg > 15) {
+    return;
+  }
+  pattern_t *pat = track_view_pattern(&view[track]);
+  trig_t *t = &pat->step[step].voice[voice];
+  t->condition = condition;
+  t->condition_arg = arg;
+  pattern_set_dirty(pat);
+  update_schedules();
+}
+
+void grid_set_fill(u8 track, bool state) {
+  if (track < GRID_NUM_TRACKS) {
+    fill[track] = state;
+    static_dirty = true;
+    monomeFrameDirty++;
+  }
+}
+
+void grid_set_clock_steps(u8 steps) {
+  // clock_steps sits in what was padding, older flash may hold anything there
+  if (steps == 0 || steps > GRID_CLOCK_STEPS_MAX) {
+    steps = 1;
+  }
+  g.clock_steps = steps;
+}
+
+void grid_set_reset_mode(u8 mode) {
+  g.reset_mode = mode < resetModeCount ? mode : resetOff;
+  reset_armed = false;
+  follow_init(&follow);
+}
+
+void grid_set_bpm(fix16_t bpm) {
+  u8 flags = irqs_pause();
+  tempo_set_bpm(&tempo, bpm);
+  g.bpm = tempo.bpm;
+  if (!clock_following()) {
+    phasor_hz = tempo_next_hz(&tempo);
+    phasor_set_frequency(phasor_hz);
+  }
+  irqs_resume(flags);
+}
+
+fix16_t grid_get_bpm(void) {
+  return g.bpm;
+}
+
+void grid_seed(u32 seed) {
+  // each track gets its own sequence so chance trigs on the two don't track
+  u8 flags = irqs_pause();
+  schedule_seed(&schedule[0], seed);
+  schedule_seed(&schedule[1], ~seed);
+  irqs_resume(flags);
 }
 
 void handler_GridKey(s32 data) {
@@ -311,95 +597,50 @@ void handler_GridKey(s32 data) {
   // print_dbg(" z: ");
   // print_dbg_ulong(z);
 
-  if (y >= 6) {
-    handle_key_control(x, y, z);
-  } else {
-    switch (ui_mode) {
-    case uiEdit:
-      handle_key_upper_step(x, y, z);
-      break;
-
-    case uiLength:
-      handle_key_upper_len(x, y, z);
-      break;
-
-    case uiPattern:
-      handle_key_upper_pat(x, y, z);
-      break;
-    }
+  if (x < GRID_WIDTH && y < GRID_HEIGHT && key_map[y][x]) {
+    const key_region_t *r = &key_regions[key_map[y][x] - 1];
+    r->handler(x - r->x, y - r->y, z);
   }
-}
 
-static void handle_key_upper_step(u8 x, u8 y, u8 z) {
-  if (y <= 2) {
-    // first track
-    do_step_key(0, x, y, z);
-  } else if (y <= 5) {
-    // second track
-    do_step_key(1, x, y - 3, z);
-  }
-}
+  // pick up any edits or pattern changes made by the key
+  update_schedules();
 
-static void handle_key_upper_len(u8 x, u8 y, u8 z) {
-  if (y <= 2) {
-    // first track
-    do_len_key(&view[0], x, y, z);
-  } else if (y <= 5) {
-    // second track
-    do_len_key(&view[1], x, y - 3, z);
-  }
+  static_dirty = true;
+  monomeFrameDirty++;
 }
 
-static void handle_key_upper_pat(u8 x, u8 y, u8 z) {
+static void set_ui_mode(ui_mode_t mode) {
+  const key_region_t *r = key_layouts[mode];
 
-  if (x <= 3) {
-    // cue area + gutter
-    if (y <= 2) {
-      handle_key_cue(0, x, y, z);
-      return;
-    } else {
-      handle_key_cue(1, x, y - 3, z);
-      return;
+  memset(key_map, 0, sizeof(key_map));
+  for (u8 i = 0; r[i].handler; i++) {
+    for (u8 y = r[i].y; y < r[i].y + r[i].h; y++) {
+      for (u8 x = r[i].x; x < r[i].x + r[i].w; x++) {
+        key_map[y][x] = i + 1;
+      }
     }
   }
 
-  // FIXME: refactor z handling
-  if (z == 0)
-    return;
+  key_regions = r;
+  ui_mode = mode;
+}
 
-  if (x <= 7) {
-    // pattern area
-    print_dbg("\r\n pattern: ");
-    u8 p = (y * 4) + (x - 4);
-    print_dbg_ulong(p);
-    // TODO: break this out into a do_track_pattern_select
-    // FIXME: this also needs to adjust the playhead
-    if (track_selection[0]) {
-      view[0].track->pattern = p;
-      print_dbg(" [t1]");
-    }
-    if (track_selection[1]) {
-      view[1].track->pattern = p;
-      print_dbg(" [t2]");
-    }
-  } else if (x == 9 || x == 10) {
-    // meta area
-    print_dbg("\r\n meta: ");
-    u8 m = (y * 2) + (x - 9);
-    print_dbg_ulong(m);
-  } else if (x == 12) {
-    // meta live area
-    if (y == 0) {
-      print_dbg("\r\n meta: live 1");
-    } else if (y == 3) {
-      print_dbg("\r\n meta: live 2");
-    }
-  } else {
-    print_dbg("\r\n empty pattern view key");
-  }
+//
+// upper area, the two tracks are stacked VOICE_COUNT rows apiece
+//
+
+static void key_steps(u8 x, u8 y, u8 z) {
+  do_step_key(y / VOICE_COUNT, x, y % VOICE_COUNT, z);
+}
+
+static void key_length(u8 x, u8 y, u8 z) {
+  do_len_key(&view[y / VOICE_COUNT], x, y % VOICE_COUNT, z);
 }
 
-static void handle_key_cue(u8 track_num, u8 x, u8 y, u8 z) {
+static void key_cue(u8 x, u8 y, u8 z) {
+  u8 track_num = y / VOICE_COUNT;
+  y = y % VOICE_COUNT;
+
   print_dbg("\r\n cue area, t: ");
   print_dbg_ulong(track_num);
   if (x < 3) {
@@ -415,7 +656,6 @@ static void handle_key_cue(u8 track_num, u8 x, u8 y, u8 z) {
       // default cue mode
       if (z == 1) {
         view[track_num].track->cue = x;
-        monomeFrameDirty++;
         print_dbg("\r\n default cue: ");
         print_dbg_ulong(x);
       }
@@ -423,165 +663,199 @@ static void handle_key_cue(u8 track_num, u8 x, u8 y, u8 z) {
   }
 }
 
-static bool handle_key_control(u8 x, u8 y, u8 z) {
+static void key_pattern(u8 x, u8 y, u8 z) {
+  // FIXME: refactor z handling
+  if (z == 0)
+    return;
+
+  print_dbg("\r\n pattern: ");
+  u8 p = (y * 4) + x;
+  print_dbg_ulong(p);
+  // TODO: break this out into a do_track_pattern_select
+  // FIXME: this also needs to adjust the playhead
+  if (track_selection[0]) {
+    view[0].track->pattern = p;
+    print_dbg(" [t1]");
+  }
+  if (track_selection[1]) {
+    view[1].track->pattern = p;
+    print_dbg(" [t2]");
+  }
+}
+
+static void key_meta(u8 x, u8 y, u8 z) {
+  if (z == 0)
+    return;
+
+  print_dbg("\r\n meta: ");
+  u8 m = (y * 2) + x;
+  print_dbg_ulong(m);
+}
+
+static void key_meta_live(u8 x, u8 y, u8 z) {
+  if (z == 0)
+    return;
+
+  if (y == 0) {
+    print_dbg("\r\n meta: live 1");
+  } else if (y == 3) {
+    print_dbg("\r\n meta: live 2");
+  }
+}
+
+//
+// control rows, y is 0 for the top row and 1 for the bottom
+//
+
+static void key_select(u8 x, u8 y, u8 z) {
   // selection / meta controls
-  if (x == 0) {
-    if (y == 6) {
-      do_row_selection(z);
-      return true;
-    } else if (y == 7) {
-      do_step_selection(z);
-      return true;
-    }
+  if (y == 0) {
+    do_row_selection(z);
+  } else {
+    do_step_selection(z);
   }
+}
 
-  // navigation
+static void key_nav(u8 x, u8 y, u8 z) {
   if (row_selection) {
-    if (y == 6) {
-      if (x == 1) {
-        // top left nav
-        ui_mode = z == 1 ? uiLength : uiEdit;
-        return true;
-      } else if (x == 2) {
-        // top right nav
-        ui_mode = z == 1 ? uiPattern : uiEdit;
-        return true;
-      }
-    } else if (y == 7) {
-      if (x == 1) {
-        // bottom left nav
-        return true;
-      } else if (x == 2) {
-        // bottom right nav
-        return true;
-      }
+    // top left holds length mode, top right holds pattern mode
+    if (y == 0) {
+      set_ui_mode(z == 1 ? (x == 0 ? uiLength : uiPattern) : uiEdit);
     }
+  } else if (z == 1) {
+    // page selection, pages run left to right then top to bottom
+    view[0].page = view[1].page = (y * 2) + x;
   }
+}
 
-  // page selection (via navigation quad)
-  if (x == 1) {
-    // left half of page select
-    if (y == 6) {
-      if (z == 1) {
-        view[0].page = view[1].page = 0;
-        return true;
-      }
-    } else if (y == 7) {
-      if (z == 1) {
-        view[0].page = view[1].page = 2;
-        return true;
-      }
-    }
-  } else if (x == 2) {
-    // right half of page select
-    if (y == 6) {
-      if (z == 1) {
-        view[0].page = view[1].page = 1;
-        return true;
-      }
-    } else if (y == 7) {
-      if (z == 1) {
-        view[0].page = view[1].page = 3;
-        return true;
-      }
+static void key_track_select(u8 x, u8 y, u8 z) {
+  track_selection[y] = z;
+  // print_dbg("\r\n track_selection = ");
+  // print_dbg_ulong(z);
+}
+
+static void key_playhead(u8 x, u8 y, u8 z) {
+  if (z == 0)
+    return;
+
+  if (x == 0) {
+    // playhead nudge back
+    view[y].playhead->nudge = -1;
+  } else if (x == 1) {
+    // playhead reset
+    if (row_selection && step_selection) {
+      print_dbg("\r\n reset both");
+      view[0].playhead->should_reset = view[1].playhead->should_reset = true;
+    } else if (row_selection && y == 0) {
+      print_dbg("\r\n reset top");
+      view[0].playhead->should_reset = true;
+    } else if (step_selection && y == 1) {
+      print_dbg("\r\n reset bottom");
+      view[1].playhead->should_reset = true;
     }
+  } else {
+    // playhead nudge forward
+    view[y].playhead->nudge = 1;
   }
+}
 
-  // track select (only in pattern mode)
-  if (ui_mode == uiPattern) {
-    if (x == 4) {
-      if (y == 6) {
-        track_selection[0] = z;
-        // print_dbg("\r\n track_selection[0] = ");
-        // print_dbg_ulong(z);
-        return true;
-      } else if (y == 7) {
-        track_selection[1] = z;
-        // print_dbg("\r\n track_selection[1] = ");
-        // print_dbg_ulong(z);
-        return true;
-      }
-    }
+static void key_ratchet(u8 x, u8 y, u8 z) {
+  // ratchet hits, 1-4 on the upper row and 5-8 on the lower
+  if (z == 1) {
+    do_focused_step_ratchet((y * 4) + x + 1);
   }
+}
 
-  // playhead (only in edit mode)
-  if (ui_mode == uiEdit && z == 1) {
-    // TODO: refactor to split up ui_modes
-    if (x == 3) {
-      // playhead nudge back
-      if (y == 6) {
-        view[0].playhead->nudge = -1;
-        return true;
-      } else if (y == 7) {
-        view[1].playhead->nudge = -1;
-        return true;
-      }
-    } else if (x == 4) {
-      // playhead reset
-      if (row_selection && step_selection && (y == 6 || y == 7)) {
-        print_dbg("\r\n reset both");
-        view[0].playhead->should_reset = view[1].playhead->should_reset = true;
-        return true;
-      } else if (row_selection && y == 6) {
-        // reset top track
-        print_dbg("\r\n reset top");
-        view[0].playhead->should_reset = true;
-        return true;
-      } else if (step_selection && y == 7) {
-        // reset bottom track
-        print_dbg("\r\n reset bottom");
-        view[1].playhead->should_reset = true;
-        return true;
-      }
-    } else if (x == 5) {
-      // playhead nudge forward
-      if (y == 6) {
-        view[0].playhead->nudge = 1;
-        return true;
-      } else if (y == 7) {
-        view[1].playhead->nudge = 1;
-        return true;
-      }
-    } else if (x >= 11) {
-      // step timing controls
-      if (y == 7) {
-        do_focused_step_timing(x - 13); // -2, -1, 0, 1, 2
-      }
+static void key_fill(u8 x, u8 y, u8 z) {
+  // the spacing key takes over the top fill key while a step is held
+  if (!step_focus.z || z == 0) {
+    grid_set_fill(y, z);
+  } else if (y == 0) {
+    do_focused_step_spacing();
+  }
+}
+
+static void key_step_edit(u8 x, u8 y, u8 z) {
+  // step gate length and timing controls
+  if (z == 1) {
+    if (y == 0) {
+      do_focused_step_length(x - 2); // -2, -1, 0, 1, 2
+    } else {
+      do_focused_step_timing(x - 2); // -2, -1, 0, 1, 2
     }
   }
-  return false;
 }
 
 void handler_GridRefresh(s32 data) {
   if (monomeFrameDirty) {
-    memset(monomeLedBuffer, 0, MONOME_MAX_LED_BYTES);
-    render_grid();
-    monome_set_quadrant_flag(0);
-    monome_set_quadrant_flag(1);
-    (*monome_refresh)();
+    u8 quadrants = 0;
+
+    // taken before rendering, playheads moving while rendering need another frame
+    playheads_moved = false;
+
+    // most frames are the playheads stepping, those are drawn over a cached
+    // copy of the rest of the grid which is only rendered after ui changes
+    if (static_dirty) {
+      static_dirty = false;
+      memset(monomeLedBuffer, 0, MONOME_MAX_LED_BYTES);
+      render_grid();
+      memcpy(led_static, monomeLedBuffer, GRID_LED_BYTES);
+    } else {
+      memcpy(monomeLedBuffer, led_static, GRID_LED_BYTES);
+    }
+    render_playheads();
+
+    for (u8 q = 0; q < GRID_NUM_QUADRANTS; q++) {
+      if (diff_quadrant(q)) {
+        quadrants |= 1 << q;
+      }
+    }
+
+    // the dirty count doubles as the quadrant flags (and rendering bumps
+    // it), replace it wholesale so only the quadrants which differ from what
+    // the grid is showing get sent. the interrupt is held off while the count
+    // is the flags, a bump would send the wrong quadrants and be lost.
+    u8 flags = irqs_pause();
+    monomeFrameDirty = quadrants;
+    if (quadrants) {
+      (*monome_refresh)();
+    }
+    monomeFrameDirty = playheads_moved;
+    irqs_resume(flags);
   }
 }
 
+static bool diff_quadrant(u8 q) {
+  bool changed = false;
+  for (u8 y = 0; y < GRID_QUADRANT_SIZE; y++) {
+    u8 i = monome_xy_idx(q * GRID_QUADRANT_SIZE, y);
+    if (memcmp(&monomeLedBuffer[i], &led_shadow[i], GRID_QUADRANT_SIZE)) {
+      memcpy(&led_shadow[i], &monomeLedBuffer[i], GRID_QUADRANT_SIZE);
+      changed = true;
+    }
+  }
+  return changed;
+}
+
 //
 // app
 //
 
-inline static u16 edge_pack(u8 level, u16 offset) {
-  edge_t e = {.f = {.set = 1, .level = level, .offset = offset}};
-  return e.v;
-}
-
 static void render_grid(void) {
   switch (ui_mode) {
   case uiEdit:
-    track_view_steps(&view[0], 0, /* show_playhead */ true);
-    track_view_steps(&view[1], 3, /* show_playhead */ true);
+    track_view_steps(&view[0], 0, /* show_playhead */ false);
+    track_view_steps(&view[1], 3, /* show_playhead */ false);
     render_nav();
     render_playhead_nudge(3, 6);
     render_playhead_nudge(3, 7);
 
     if (step_focus.z) {
+      render_step_ratchet(6, 6);
+      render_step_nudge(11, 6);
       render_step_nudge(11, 7);
+    } else {
+      render_fill(10, 6);
     }
     break;
 
@@ -606,6 +880,13 @@ static void render_grid(void) {
   }
 }
 
+static void render_playheads(void) {
+  if (ui_mode == uiEdit) {
+    track_view_playhead(&view[0], 0);
+    track_view_playhead(&view[1], 3);
+  }
+}
+
 static void render_nav(void) {
   u8 curr_page = view[0].page; // NOTE: assumes both track
   monomeLedBuffer[monome_xy_idx(1, 6)] = 0 == curr_page ? L2 : L1;
@@ -630,6 +911,20 @@ static void render_step_nudge(u8 x, u8 y) {
   monomeLedBuffer[offset + 4] = L2; // coarse nudge late
 }
 
+static void render_step_ratchet(u8 x, u8 y) {
+  pattern_t *pat = track_view_pattern(&view[step_focus.track]);
+  trig_t *t = &pat->step[step_focus.step].voice[step_focus.voice];
+  for (u8 i = 0; i < RATCHET_MAX; i++) {
+    monomeLedBuffer[monome_xy_idx(x + (i & 3), y + (i >> 2))] = i == t->ratchet ? L3 : L1;
+  }
+  monomeLedBuffer[monome_xy_idx(x + 4, y)] = t->spacing ? L3 : L1;
+}
+
+static void render_fill(u8 x, u8 y) {
+  monomeLedBuffer[monome_xy_idx(x, y)] = fill[0] ? L3 : L1;
+  monomeLedBuffer[monome_xy_idx(x, y + 1)] = fill[1] ? L3 : L1;
+}
+
 static void render_track_select(u8 x, u8 y) {
   monomeLedBuffer[monome_xy_idx(x, y)] = L1;
   monomeLedBuffer[monome_xy_idx(x, y + 1)] = L1;
@@ -697,67 +992,238 @@ static void render_meta_area(u8 x, u8 y) {
 static void render_meta_buffer_bar(u8 x, u8 y) {
 }
 
-static void build_waves(void) {
-  memset(&waves, 0, sizeof(waves));
+static void update_schedules(void) {
+  // patterns can be shared between tracks so only clear the dirty flags once
+  // every schedule has had the chance to see them
+  for (u8 tn = 0; tn < GRID_NUM_TRACKS; tn++) {
+    pattern_t *pat = track_view_pattern(&view[tn]);
+    if (schedule_stale(&schedule[tn], pat, view[tn].track)) {
+      schedule_compile(&schedule[tn], pat, view[tn].track);
+    }
+  }
+  for (u8 tn = 0; tn < GRID_NUM_TRACKS; tn++) {
+    track_view_pattern(&view[tn])->dirty = 0;
+  }
+}
+
+static void add_event(u8 wn, u8 offset, u8 level) {
+  tick_used[offset >> 5] |= 0x80000000UL >> (offset & 31);
+  if (level) {
+    tick_set[offset] |= 1 << wn;
+  } else {
+    tick_clr[offset] |= 1 << wn;
+  }
+}
+
+static void init_gates(void) {
+  for (u8 i = 0; i < GRID_NUM_GATES; i++) {
+    gates[i].next = i + 1;
+  }
+  gates[GRID_NUM_GATES - 1].next = GRID_NO_GATE;
+  free_gate = 0;
+  memset(pending, GRID_NO_GATE, sizeof(pending));
+}
+
+static bool add_gate(u8 wn, u16 rise, u16 fall) {
+  u8 *link = &pending[wn];
+
+  // skip over the gates which end before this one starts
+  while (*link != GRID_NO_GATE && (s16)(gates[*link].fall - rise) < 0) {
+    link = &gates[*link].next;
+  }
+
+  u8 i = *link;
+  if (i != GRID_NO_GATE && (s16)(gates[i].rise - fall) <= 0) {
+    // gates which overlap (or touch) are tied, the output stays high over both
+    gate_t *g = &gates[i];
+    if ((s16)(rise - g->rise) < 0) {
+      g->rise = rise;
+    }
+    if ((s16)(fall - g->fall) > 0) {
+      g->fall = fall;
+    }
+    // a longer gate can swallow the ones which follow it
+    while (g->next != GRID_NO_GATE && (s16)(gates[g->next].rise - g->fall) <= 0) {
+      u8 n = g->next;
+      if ((s16)(gates[n].fall - g->fall) > 0) {
+        g->fall = gates[n].fall;
+      }
+      g->next = gates[n].next;
+      gates[n].next = free_gate;
+      free_gate = n;
+    }
+    return true;
+  }
+
+  if (free_gate == GRID_NO_GATE) {
+    return false;
+  }
+
+  u8 n = free_gate;
+  free_gate = gates[n].next;
+  gates[n].rise = rise;
+  gates[n].fall = fall;
+  gates[n].high = 0;
+  gates[n].next = i;
+  *link = n;
+  return true;
+}
+
+static void load_gates(u8 wn) {
+  u8 i;
+  while ((i = pending[wn]) != GRID_NO_GATE) {
+    gate_t *g = &gates[i];
+    if (!g->high) {
+      u16 offset = g->rise - step_tick;
+      if (offset >= PPQ) {
+        break;
+      }
+      add_event(wn, offset, 1);
+      g->high = 1;
+    }
+
+    u16 offset = g->fall - step_tick;
+    if (offset >= PPQ) {
+      break;
+    }
+    add_event(wn, offset, 0);
+
+    // gate complete, return it to the pool
+    pending[wn] = g->next;
+    g->next = free_gate;
+    free_gate = i;
+  }
+}
+
+static void load_events(void) {
+  trig_edges_t *trig[GRID_NUM_OUTPUTS];
+
+  step_tick += PPQ;
 
   u8 wn = 0;
-  for (u8 tn = 0; tn < 2; tn++) {
+  u8 hits = 0; // most hits on any output
+  for (u8 tn = 0; tn < GRID_NUM_TRACKS; tn++) {
     u8 sn = playhead_position(&playhead[tn]);
-
+    step_edges_t *step = schedule_step(&schedule[tn], sn);
+    u8 iteration = schedule_iterate(&schedule[tn], sn);
     for (u8 v = 0; v < VOICE_COUNT; v++) {
-      u8 edge_idx = 0;
-      // add falling edge for gates which are high at the end of the previous phasor cycle
-      if (carry[wn].f.set) {
-        waves[wn].edges[edge_idx].v = carry[wn].v;
-        carry[wn].v = 0; // clear the carry so we don't repeat
+      // conditions are settled once here for the whole step (ratchet included)
+      trig_edges_t *t = &step->voice[v];
+      bool plays = t->rise.f.set && schedule_trig_plays(&schedule[tn], t, iteration, fill[tn]);
+      trig[wn++] = plays ? t : NULL;
+      if (plays && t->hits > hits) {
+        hits = t->hits;
       }
+    }
+    // 4th tr is left alone
+    trig[wn++] = NULL;
+  }
 
-      pattern_t *pat = track_view_pattern(&view[tn]);
-      trig_t t = pat->step[sn].voice[v];
-
-      if (t.enabled && t.value) {
-        // determine rise
-        u8 rise = MID_PHASE + t.timing;
-        if (waves[wn].edges[edge_idx].f.set) {
-          if (rise > waves[wn].edges[edge_idx].f.offset) {
-            // only add a trigger if lands after the previous, otherwise tie
-            ++edge_idx;
-            waves[wn].edges[edge_idx++].v = edge_pack(1, rise);
-          } else {
-            // rise comes before previous fall, erase previous fall
-            waves[wn].edges[edge_idx].v = 0;
-          }
-        } else {
-          waves[wn].edges[edge_idx++].v = edge_pack(1, rise);
-        }
-
-        // determine fall
-        u8 fall = rise + 4;
-        if (fall > PPQ) {
-          carry[wn].v = edge_pack(0, fall - PPQ);
-        } else {
-          // FIXME: what happens if fall == PPQ?
-          waves[wn].edges[edge_idx++].v = edge_pack(0, fall);
+  // the first hit on every output goes in ahead of any ratchet hits so if the
+  // pool runs short it is the trailing hits which are dropped
+  for (u8 h = 0; h < hits; h++) {
+    for (wn = 0; wn < GRID_NUM_OUTPUTS; wn++) {
+      trig_edges_t *t = trig[wn];
+      if (t && h < t->hits) {
+        u16 delay = (h * (PPQ >> t->spacing)) / t->hits;
+        u16 rise = step_tick + t->rise.f.offset + delay;
+        if (!add_gate(wn, rise, step_tick + t->fall + delay)) {
+          dropped_gates++;
         }
       }
-      wn++;
     }
+  }
 
-    // extra to skip over 4th tr
-    wn++;
+  for (wn = 0; wn < GRID_NUM_OUTPUTS; wn++) {
+    load_gates(wn);
   }
+
+  // collect the per tick masks into the event list, only the ticks which
+  // have edges are visited (clz is a single instruction on the avr32)
+  event_count = 0;
+  for (u8 w = 0; w < PPQ / 32; w++) {
+    u32 used = tick_used[w];
+    tick_used[w] = 0;
+    while (used) {
+      u8 b = __builtin_clz(used);
+      u8 i = (w << 5) + b;
+      used &= ~(0x80000000UL >> b);
+      grid_event_t *e = &events[event_count++];
+      e->offset = i;
+      e->set = tick_set[i];
+      e->clr = tick_clr[i];
+      tick_set[i] = tick_clr[i] = 0;
+    }
+  }
+
+  events[event_count].offset = GRID_NO_EVENT;
+  next_event = 0;
+}
+
+// the phasor follows the clock input unless it is used as a reset
+static bool clock_following(void) {
+  return external_clock && g.reset_mode == resetOff;
+}
+
+// back to the internal tempo after following the clock input
+static void resume_tempo(void) {
+  u8 flags = irqs_pause();
+  phasor_hz = tempo_next_hz(&tempo);
+  phasor_set_frequency(phasor_hz);
+  irqs_resume(flags);
+}
+
+// called from the clock input interrupt. the reset is taken by the phasor at
+// the start of a step, for resetTick the phasor is restarted so that is the
+// next tick. the tick count is returned for the clock follower.
+static u16 grid_clock_input(u8 level) {
+  if (level && g.reset_mode != resetOff) {
+    reset_armed = true;
+    if (g.reset_mode == resetTick) {
+      phasor_reset();
+    }
+  }
+  return phasor_tick;
 }
 
 static void process_phasor(u8 now, bool reset) {
+  PROFILE_BEGIN();
+
+  // kept a multiple of PPQ at the start of each step (a phasor reset can cut
+  // one short) so the clock follower can lock steps to the pulses
+  phasor_tick = now == MIN_PHASE ? (phasor_tick | (PPQ - 1)) + 1 : phasor_tick + 1;
+
   switch (now) {
   case MIN_PHASE:
+    if (!clock_following()) {
+      // switch between the whole hz rates either side of the tempo
+      u16 hz = tempo_next_hz(&tempo);
+      if (hz != phasor_hz) {
+        phasor_hz = hz;
+        phasor_set_frequency(hz);
+      }
+    }
+    if (reset_armed && (reset || g.reset_mode != resetBar || bar_step == 0)) {
+      reset_armed = false;
+      bar_step = 0;
+      playhead[0].should_reset = playhead[1].should_reset = true;
+      if (reset) {
+        // the step was cut short, drop what it left pending
+        clr_tr_all();
+        init_gates();
+      }
+    }
+    bar_step = (bar_step + 1) % GRID_BAR_STEPS;
     playhead_advance(&playhead[0]);
     playhead_advance(&playhead[1]);
-    // calculate waveform; this could be too expensive
-    build_waves();
+    // edges are precompiled per step, only pending gates need merging here
+    load_events();
+    PROFILE_END(profile_step);
     break;
 
   case MID_PHASE:
+    // playheads moved, only they are redrawn unless the ui has changed
+    playheads_moved = true;
     monomeFrameDirty++;
     // clock out high
     gpio_set_gpio_pin(B10);
@@ -769,13 +1235,14 @@ static void process_phasor(u8 now, bool reset) {
     break;
   }
 
-  for (u8 wn = 0; wn < 8; wn++) {
-    edge_t edge = waves[wn].edges[waves[wn].cursor];
-    if (edge.f.set && edge.f.offset == now) {
-      edge.f.level ? set_tr(wn) : clr_tr(wn);
-      waves[wn].cursor++;
-    }
+  // events are merged across outputs so most ticks end at this compare
+  grid_event_t *e = &events[next_event];
+  if (e->offset == now) {
+    set_tr_mask(e->set, e->clr);
+    next_event++;
   }
+
+  PROFILE_END(profile_tick);
 }
 
 inline static void do_step_selection(u8 state) {
@@ -808,6 +1275,7 @@ static void do_step_key(u8 tn, u8 x, u8 y, u8 z) {
 
       if (step_get(s, y) == 0) {
         step_set(s, y, 1);
+        pattern_set_dirty(pat);
         step_focus.z = 1;
         step_focus.fresh_trig = true;
         // print_dbg("\r\n > trig set");
@@ -819,6 +1287,7 @@ static void do_step_key(u8 tn, u8 x, u8 y, u8 z) {
       if (step_focus.hold_count > 0 && step_get(s, y) != 0 && !step_focus.fresh_trig) {
         // quick press and release, toggle
         step_set(s, y, 0);
+        pattern_set_dirty(pat);
         // print_dbg("\r\n > trig clear");
       }
       step_focus.z = 0;
@@ -835,6 +1304,7 @@ static void do_len_key(track_view_t *v, u8 x, u8 y, u8 z) {
       // pages
       if (x < 4) {
         v->playhead->max = pat->length = (x + 1) * PAGE_SIZE;
+        pattern_set_dirty(pat);
         // print_dbg("\r\nlen: ");
         // print_dbg_ulong(v->track->length);
       }
@@ -851,6 +1321,7 @@ static void do_len_key(track_view_t *v, u8 x, u8 y, u8 z) {
       // print_dbg_ulong(base);
       if (x < 15) {
         v->playhead->max = pat->length = min(base + x + 1, PATTERN_STEP_MAX);
+        pattern_set_dirty(pat);
       }
       print_dbg("\r\n len: ");
       print_dbg_ulong(pat->length);
@@ -880,6 +1351,61 @@ static void do_focused_step_timing(s8 direction) {
           print_dbg_ulong(t->timing);
         }
       }
+      pattern_set_dirty(pat);
+    } else {
+      print_dbg("\r\n focused step > pattern length");
+    }
+  }
+}
+
+static void do_focused_step_ratchet(u8 hits) {
+  if (step_focus.z == 1) {
+    pattern_t *pat = track_view_pattern(&view[step_focus.track]);
+    if (step_focus.step < pat->length) {
+      trig_t *t = &pat->step[step_focus.step].voice[step_focus.voice];
+      t->ratchet = hits - 1;
+      print_dbg("\r\n ratchet = ");
+      print_dbg_ulong(hits);
+      pattern_set_dirty(pat);
+    } else {
+      print_dbg("\r\n focused step > pattern length");
+    }
+  }
+}
+
+static void do_focused_step_spacing(void) {
+  if (step_focus.z == 1) {
+    pattern_t *pat = track_view_pattern(&view[step_focus.track]);
+    if (step_focus.step < pat->length) {
+      trig_t *t = &pat->step[step_focus.step].voice[step_focus.voice];
+      t->spacing = !t->spacing;
+      print_dbg("\r\n spacing = ");
+      print_dbg_ulong(t->spacing);
+      pattern_set_dirty(pat);
+    } else {
+      print_dbg("\r\n focused step > pattern length");
+    }
+  }
+}
+
+static void do_focused_step_length(s8 direction) {
+  if (step_focus.z == 1) {
+    pattern_t *pat = track_view_pattern(&view[step_focus.track]);
+    if (step_focus.step < pat->length) {
+      trig_t *t = &pat->step[step_focus.step].voice[step_focus.voice];
+      if (direction == 0) {
+        t->length = 0;
+        print_dbg("\r\n length reset");
+      } else {
+        s8 delta = direction;
+        if (direction == -2 || direction == 2) {
+          delta *= 2;
+        }
+        t->length = sclip(t->length + delta, 0, GATE_LENGTH_COUNT - 1);
+        print_dbg("\r\n length = ");
+        print_dbg_ulong(gate_lengths[t->length]);
+      }
+      pattern_set_dirty(pat);
     } else {
       print_dbg("\r\n focused step > pattern length");
     }
@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include "libfixmath/fix16.h"
+
 #include "meta.h"
 #include "track.h"
 
@@ -15,17 +17,33 @@
 #define GRID_NUM_META 12
 
 typedef struct {
-  u16 clock_rate;
   track_t track[GRID_NUM_TRACKS];
   pattern_t pattern[GRID_NUM_PATTERNS];
   meta_pattern_t meta[GRID_NUM_META];
 } preset_t;
 
+#define GRID_CLOCK_STEPS_MAX 16
+#define GRID_BAR_STEPS 16
+
+// what a pulse on the clock input does, with anything but resetOff the input
+// resets the playheads (on the next tick, step or bar) instead of clocking
+typedef enum { resetOff = 0, resetTick, resetStep, resetBar, resetModeCount } reset_mode_t;
+
 typedef struct {
-  u16 clock_rate; // global clock rate
+  fix16_t bpm;    // internal clock tempo
   u8 preset;      // which preset is selected
+  u8 clock_steps; // steps advanced per external clock pulse [1-GRID_CLOCK_STEPS_MAX]
+  u8 reset_mode;  // reset_mode_t
 } global_t;
 
+// ii ops, the first byte of a message with each argument following as a byte.
+// they start clear of the meadowphysics ops teletype sends to this address.
+// tracks are numbered from 0, edits to the working preset are not saved.
+#define II_GRID_RESET_MODE 0x10  // reset_mode_t, saved
+#define II_GRID_GROOVE 0x11      // track, groove_t index, swing
+#define II_GRID_CONDITION 0x12   // track, step, voice, condition_t, condition_arg
+#define II_GRID_CLOCK_STEPS 0x13 // steps per clock input pulse [1-GRID_CLOCK_STEPS_MAX], saved
+
 // grid mode values saved to nvram
 typedef struct {
   global_t g;
@@ -41,4 +59,12 @@ void default_grid(void);
 void init_grid(void);
 void resume_grid(void);
 void clock_grid(u8 phase);
+void grid_set_groove(u8 track, u8 groove, s8 swing);
+void grid_set_condition(u8 track, u8 step, u8 voice, u8 condition, u8 arg);
+void grid_set_fill(u8 track, bool state);
+void grid_seed(u32 seed);
+void grid_set_clock_steps(u8 steps);
+void grid_set_reset_mode(u8 mode);
+void grid_set_bpm(fix16_t bpm);
+fix16_t grid_get_bpm(void);
 void ii_grid(uint8_t *d, uint8_t l);
@@ -38,8 +38,7 @@ void enter_mode_midi(void) {
   app_event_handlers[kEventTr] = &handler_MidiTr;
   app_event_handlers[kEventTrNormal] = &handler_MidiTrNormal;
   app_event_handlers[kEventMidiPacket] = &handler_MidiPacket;
-
-  clock_set(midi_state.clock_period);
+  app_event_handlers[kEventPollADC] = &handler_None;
 
   process_ii = &ii_midi;
 
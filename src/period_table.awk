@@ -0,0 +1,32 @@
+# generates period_table.c, see period_table.h
+#
+#   awk -f period_table.awk > period_table.c
+#
+# knob position to 16.16 bpm. the tempo rises exponentially from 7.5 bpm at
+# index 0 to 312.5 bpm at the last index, the same range the old soft timer
+# mapping covered. it ran p = 1000 ms to 24 ms per half sixteenth note, so
+# the table is still spaced in p and converted with 60000 / (8 * p) bpm.
+
+BEGIN {
+  size = 1024
+  slow = 1000
+  fast = 24
+
+  print "// generated by period_table.awk, do not edit"
+  print ""
+  print "#include \"period_table.h\""
+  print ""
+  print "const fix16_t period_bpm[PERIOD_TABLE_SIZE] = {"
+  for (i = 0; i < size; i++) {
+    period = slow * exp(log(fast / slow) * i / (size - 1))
+    bpm = 7500 / period
+    line = line sprintf("%9d,", int(bpm * 65536 + 0.5))
+    if (i % 8 == 7) {
+      print "  " line
+      line = ""
+    } else {
+      line = line " "
+    }
+  }
+  print "};"
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "libfixmath/fix16.h"
+#include "types.h"
+
+// knob position to clock tempo, generated by period_table.awk. the half clock
+// periods behind it fall exponentially from slow to fast, so each knob step
+// changes the tempo by the same ratio. the old 25000 / (i + 25) mapping was
+// the one linear in tempo. entries are 16.16 bpm so the knob indexes the
+// tempo directly.
+
+#define PERIOD_TABLE_SIZE 1024
+
+extern const fix16_t period_bpm[PERIOD_TABLE_SIZE];
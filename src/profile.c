@@ -0,0 +1,122 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// asf
+#include "print_funcs.h"
+#include "string.h"
+
+// libavr32
+#include "interrupts.h"
+
+// this
+#include "conf_board.h"
+#include "profile.h"
+
+profile_t profile_tick;
+profile_t profile_step;
+profile_t profile_div;
+
+void profile_add(profile_t *p, u32 cycles) {
+  p->calls++;
+  p->total += cycles;
+  if (p->calls == 1 || cycles < p->min) {
+    p->min = cycles;
+  }
+  if (cycles > p->max) {
+    p->max = cycles;
+  }
+}
+
+static void profile_print_cycles(const char *label, u32 cycles) {
+  print_dbg(label);
+  print_dbg_ulong(cycles);
+  print_dbg(" (");
+  // widened, cycles * 1000 overflows past ~70 ms at FMCK_HZ
+  print_dbg_ulong((u64)cycles * 1000 / (FMCK_HZ / 1000000));
+  print_dbg(" ns)");
+}
+
+static void profile_print_counts(profile_t *p) {
+  print_dbg(": calls ");
+  print_dbg_ulong(p->calls);
+  if (p->calls) {
+    profile_print_cycles(" min ", p->min);
+    profile_print_cycles(" mean ", p->total / p->calls);
+    profile_print_cycles(" max ", p->max);
+  }
+}
+
+static void profile_print(const char *name, profile_t *p) {
+  print_dbg("\r\n ");
+  print_dbg(name);
+  profile_print_counts(p);
+}
+
+void profile_report(void) {
+  profile_t tick, step, div;
+
+  // snapshot and restart so each report covers one interval
+  u8 flags = irqs_pause();
+  tick = profile_tick;
+  step = profile_step;
+  div = profile_div;
+  memset(&profile_tick, 0, sizeof(profile_t));
+  memset(&profile_step, 0, sizeof(profile_t));
+  memset(&profile_div, 0, sizeof(profile_t));
+  irqs_resume(flags);
+
+  print_dbg("\r\n> profile (cycles)");
+  profile_print("tick", &tick);
+  profile_print("step", &step);
+  profile_print("div", &div);
+}
+
+#ifdef TRANSIT_PROFILE
+
+event_stats_t event_stats;
+
+void profile_depth(u8 depth) {
+  if (depth > event_stats.depth_max) {
+    event_stats.depth_max = depth;
+  }
+}
+
+void profile_ring_depth(u8 input, u8 timer) {
+  if (input > event_stats.input_depth_max) {
+    event_stats.input_depth_max = input;
+  }
+  if (timer > event_stats.timer_depth_max) {
+    event_stats.timer_depth_max = timer;
+  }
+}
+
+void event_stats_reset(void) {
+  u8 flags = irqs_pause();
+  memset(&event_stats, 0, sizeof(event_stats_t));
+  irqs_resume(flags);
+}
+
+void event_stats_report(void) {
+  print_dbg("\r\n> event stats (cycles)");
+  for (u8 i = 0; i < kNumEventTypes; i++) {
+    // only the event types which have been seen
+    if (event_stats.handler[i].calls) {
+      print_dbg("\r\n event ");
+      print_dbg_ulong(i);
+      profile_print_counts(&event_stats.handler[i]);
+    }
+  }
+  print_dbg("\r\n depth max ");
+  print_dbg_ulong(event_stats.depth_max);
+  print_dbg(" input ring ");
+  print_dbg_ulong(event_stats.input_depth_max);
+  print_dbg(" timer ring ");
+  print_dbg_ulong(event_stats.timer_depth_max);
+  print_dbg(" dropped ");
+  print_dbg_ulong(event_stats.dropped);
+}
+
+#endif
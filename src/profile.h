@@ -0,0 +1,67 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+// libavr32
+#include "compiler.h"
+#include "events.h"
+#include "types.h"
+
+// cycle counts for the timing critical callbacks and the main loop event
+// handlers, build with -D TRANSIT_PROFILE to enable (see config.mk). the host
+// tests build dispatch.c that way to check the event stats.
+
+typedef struct {
+  u32 calls;
+  u32 total; // cycles
+  u32 min;   // best case cycles for a single call
+  u32 max;   // worst case cycles for a single call
+} profile_t;
+
+typedef struct {
+  profile_t handler[kNumEventTypes]; // per app_event_handlers[] entry
+  u8 depth_max;                      // most events waiting to be handled at once
+  u8 input_depth_max;                // most events waiting in the clock input ring
+  u8 timer_depth_max;                // most events waiting in the soft timer ring
+  u32 dropped;                       // events which could not be posted
+} event_stats_t;
+
+#ifdef TRANSIT_PROFILE
+
+#include "cycle_counter.h"
+
+#define PROFILE_BEGIN() u32 profile_start = Get_sys_count()
+#define PROFILE_END(p) profile_add(&(p), Get_sys_count() - profile_start)
+#define PROFILE_EVENT_END(type) PROFILE_END(event_stats.handler[type])
+#define PROFILE_DEPTH(n) profile_depth(n)
+#define PROFILE_RING_DEPTH(input, timer) profile_ring_depth(input, timer)
+#define PROFILE_DROP() (event_stats.dropped++)
+
+extern event_stats_t event_stats;
+
+void profile_depth(u8 depth);
+void profile_ring_depth(u8 input, u8 timer);
+void event_stats_reset(void);
+void event_stats_report(void);
+
+#else
+
+#define PROFILE_BEGIN()
+#define PROFILE_END(p)
+#define PROFILE_EVENT_END(type)
+#define PROFILE_DEPTH(n)
+#define PROFILE_RING_DEPTH(input, timer)
+#define PROFILE_DROP()
+
+#endif
+
+extern profile_t profile_tick; // phasor callback
+extern profile_t profile_step; // grid step boundary (playhead + edge merge)
+extern profile_t profile_div;  // div clock pulse
+
+void profile_add(profile_t *p, u32 cycles);
+void profile_report(void);
@@ -0,0 +1,143 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// asf
+#include "string.h"
+
+// libavr32
+#include "interrupts.h"
+#include "util.h"
+
+// this
+#include "mode_common.h"
+#include "schedule.h"
+
+// clang-format off
+const groove_t grooves[GROOVE_COUNT] = {
+  // straight
+  {{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}},
+  // laid back, backbeat and off beat 16ths drag
+  {{0, 2, 0, 2, 4, 2, 0, 2, 0, 2, 0, 2, 4, 2, 0, 2}},
+  // push, off beat 8ths rush
+  {{0, 0, -3, 0, 0, 0, -3, 0, 0, 0, -3, 0, 0, 0, -3, 0}},
+  // shuffle, triplet feel on the off beat 16ths
+  {{0, 10, 0, 10, 0, 10, 0, 10, 0, 10, 0, 10, 0, 10, 0, 10}},
+};
+
+const every_t every_n_of_m[EVERY_COUNT] = {
+  {1, 2}, {2, 2}, {1, 3}, {2, 3}, {3, 3}, {1, 4}, {2, 4}, {3, 4},
+  {4, 4}, {1, 6}, {4, 6}, {1, 8}, {5, 8}, {8, 8}, {1, 16}, {9, 16},
+};
+// clang-format on
+
+inline static u16 edge_pack(u8 level, u16 offset) {
+  edge_t e = {.f = {.set = 1, .level = level, .offset = offset}};
+  return e.v;
+}
+
+static void compile_trig(trig_edges_t *e, trig_t *t, s8 groove) {
+  e->rise.v = 0;
+  e->fall = 0;
+  e->hits = 0;
+
+  if (t->enabled && t->value) {
+    u8 rise = sclip(MID_PHASE + t->timing + groove, MIN_PHASE, MAX_PHASE);
+    u16 width = gate_lengths[t->length];
+
+    e->hits = t->ratchet + 1;
+    e->spacing = t->spacing;
+    if (e->hits > 1) {
+      // keep hits distinct by limiting them to half the gap between hits
+      width = max(1, min(width, (PPQ >> e->spacing) / e->hits / 2));
+    }
+    e->condition = t->condition;
+    e->condition_arg = t->condition_arg;
+
+    e->rise.v = edge_pack(1, rise);
+    e->fall = rise + width;
+  }
+}
+
+void schedule_init(schedule_t *s) {
+  memset(s, 0, sizeof(schedule_t));
+  schedule_seed(s, 1);
+}
+
+void schedule_compile(schedule_t *s, pattern_t *pattern, track_t *track) {
+  step_edges_t edges;
+  const groove_t *groove = &grooves[track->groove < GROOVE_COUNT ? track->groove : 0];
+
+  for (u8 sn = 0; sn < PATTERN_STEP_MAX; sn++) {
+    // steps past the end of the pattern are left silent
+    memset(&edges, 0, sizeof(edges));
+    if (sn < pattern->length) {
+      s8 offset = groove->offset[sn % GROOVE_STEPS];
+      if (sn & 1) {
+        offset += track->swing;
+      }
+      for (u8 v = 0; v < VOICE_COUNT; v++) {
+        compile_trig(&edges.voice[v], &pattern->step[sn].voice[v], offset);
+      }
+    }
+
+    // the phasor callback reads the schedule, swap in each step atomically
+    u8 flags = irqs_pause();
+    s->step[sn] = edges;
+    irqs_resume(flags);
+  }
+
+  if (s->pattern != pattern) {
+    // every n of m counts start over with a new pattern
+    memset(s->iteration, 0, sizeof(s->iteration));
+  }
+
+  s->pattern = pattern;
+  s->groove = track->groove;
+  s->swing = track->swing;
+}
+
+bool schedule_stale(schedule_t *s, pattern_t *pattern, track_t *track) {
+  return s->pattern != pattern || pattern->dirty || s->groove != track->groove ||
+         s->swing != track->swing;
+}
+
+step_edges_t *schedule_step(schedule_t *s, u8 step) {
+  return &s->step[step];
+}
+
+void schedule_seed(schedule_t *s, u32 seed) {
+  // xorshift never leaves (or reaches) zero
+  s->rand = seed ? seed : 1;
+}
+
+u8 schedule_iterate(schedule_t *s, u8 step) {
+  u8 i = s->iteration[step];
+  s->iteration[step] = i + 1 < ITERATION_WRAP ? i + 1 : 0;
+  return i;
+}
+
+inline static u32 schedule_rand(schedule_t *s) {
+  u32 x = s->rand;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return s->rand = x;
+}
+
+bool schedule_trig_plays(schedule_t *s, trig_edges_t *t, u8 iteration, bool fill) {
+  switch (t->condition) {
+  case condChance:
+    return (schedule_rand(s) >> 28) <= t->condition_arg;
+  case condEvery: {
+    const every_t *e = &every_n_of_m[t->condition_arg];
+    return iteration % e->m == e->n - 1;
+  }
+  case condFill:
+    return fill != (t->condition_arg & 1);
+  default:
+    return true;
+  }
+}
@@ -0,0 +1,100 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+// libavr32
+#include "compiler.h"
+#include "types.h"
+
+// this
+#include "track.h"
+
+//
+// edge
+//
+
+typedef union {
+  struct {
+    u16 set : 1;
+    u16 level : 1;
+    u16 offset : 14;
+  } f;
+  u16 v;
+} edge_t;
+
+//
+// groove
+//
+// per step timing offsets (in ticks) which are folded into the schedule when
+// it is compiled, templates repeat every GROOVE_STEPS steps
+//
+
+#define GROOVE_STEPS 16
+#define GROOVE_COUNT 4
+
+typedef struct {
+  s8 offset[GROOVE_STEPS];
+} groove_t;
+
+extern const groove_t grooves[GROOVE_COUNT];
+
+//
+// conditions
+//
+// "every n of m" trigs play on the nth of each m iterations of their step,
+// the iteration count wraps at a multiple of every m so the cycle is unbroken
+//
+
+#define EVERY_COUNT 16
+#define ITERATION_WRAP 240
+
+typedef struct {
+  u8 n;
+  u8 m;
+} every_t;
+
+extern const every_t every_n_of_m[EVERY_COUNT];
+
+//
+// schedule
+//
+// a schedule is the pattern compiled down to the edges each trig produces
+// relative to the start of its step. it is (re)compiled from the main loop
+// whenever the pattern is marked dirty so the phasor callback only has to
+// look up the current step.
+//
+
+typedef struct {
+  edge_t rise; // rising edge within the step
+  u16 fall;    // ticks from the start of the step to the falling edge, gates
+               // longer than a step fall in one of the following steps
+  u8 hits;     // number of ratchet hits, spread evenly over PPQ >> spacing ticks
+  u8 spacing : 1;
+  u8 condition : 2;     // copied from the trig, evaluated as the step is loaded
+  u8 condition_arg : 4;
+} trig_edges_t;
+
+typedef struct {
+  trig_edges_t voice[VOICE_COUNT];
+} step_edges_t;
+
+typedef struct {
+  pattern_t *pattern; // pattern the schedule was compiled from
+  u8 groove;          // timing the schedule was compiled with
+  s8 swing;
+  u32 rand;                       // xorshift state for chance conditions
+  u8 iteration[PATTERN_STEP_MAX]; // times each step has played, shared by its trigs
+  step_edges_t step[PATTERN_STEP_MAX];
+} schedule_t;
+
+void schedule_init(schedule_t *s);
+void schedule_compile(schedule_t *s, pattern_t *pattern, track_t *track);
+bool schedule_stale(schedule_t *s, pattern_t *pattern, track_t *track);
+step_edges_t *schedule_step(schedule_t *s, u8 step);
+void schedule_seed(schedule_t *s, u32 seed);
+u8 schedule_iterate(schedule_t *s, u8 step);
+bool schedule_trig_plays(schedule_t *s, trig_edges_t *t, u8 iteration, bool fill);
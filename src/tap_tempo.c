@@ -0,0 +1,73 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// this
+#include "tap_tempo.h"
+
+void tap_init(tap_t *t) {
+  t->last = 0;
+  t->next = 0;
+  t->count = 0;
+  t->started = false;
+}
+
+static u32 tap_median(tap_t *t) {
+  u32 sorted[TAP_HISTORY];
+  u8 n = t->count;
+
+  for (u8 i = 0; i < n; i++) {
+    u32 v = t->interval[i];
+    u8 j = i;
+    for (; j > 0 && sorted[j - 1] > v; j--) {
+      sorted[j] = sorted[j - 1];
+    }
+    sorted[j] = v;
+  }
+  return sorted[n >> 1];
+}
+
+// called for each press with its timestamp (in time_hz units). returns the
+// beat period in the same units, or 0 while there isn't one yet.
+u32 tap_press(tap_t *t, u32 time, u32 time_hz) {
+  u32 interval = time - t->last;
+  t->last = time;
+
+  if (!t->started || interval > time_hz / 1000 * TAP_TIMEOUT_MS) {
+    // first tap of a run only marks the time
+    t->started = true;
+    t->count = 0;
+    t->next = 0;
+    return 0;
+  }
+
+  if (t->count) {
+    u32 median = tap_median(t);
+    if (interval > median * TAP_RESTART || interval * TAP_RESTART < median) {
+      t->count = 0;
+      t->next = 0;
+    }
+  }
+
+  t->interval[t->next] = interval;
+  t->next = (t->next + 1) % TAP_HISTORY;
+  if (t->count < TAP_HISTORY) {
+    t->count++;
+  }
+
+  // mean of the intervals close to the median, the median itself always is
+  u32 median = tap_median(t);
+  u32 tolerance = median >> TAP_TOLERANCE;
+  u32 sum = 0;
+  u8 n = 0;
+  for (u8 i = 0; i < t->count; i++) {
+    u32 v = t->interval[i];
+    if (v + tolerance >= median && v <= median + tolerance) {
+      sum += v;
+      n++;
+    }
+  }
+  return (sum + (n >> 1)) / n;
+}
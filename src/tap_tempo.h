@@ -0,0 +1,37 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+// libavr32
+#include "compiler.h"
+#include "types.h"
+
+//
+// tap tempo
+//
+// turns button press timestamps into a beat period. the period is the mean
+// of the last few intervals which are within TAP_TOLERANCE of their median,
+// so a fumbled tap is dropped rather than averaged in. a pause longer than
+// TAP_TIMEOUT_MS starts a new run of taps, as does an interval which is
+// nowhere near the others (a deliberate change of tempo).
+//
+
+#define TAP_HISTORY 5       // intervals the period is taken over
+#define TAP_TOLERANCE 3     // intervals within 1 / 2^n of the median are averaged
+#define TAP_RESTART 2       // interval ratio treated as a new tempo
+#define TAP_TIMEOUT_MS 2000 // taps further apart than this start over
+
+typedef struct {
+  u32 last;                  // timestamp of the last tap
+  u32 interval[TAP_HISTORY]; // recent intervals, oldest is overwritten
+  u8 next;                   // slot for the next interval
+  u8 count;                  // intervals held
+  bool started;              // a first tap has been seen
+} tap_t;
+
+void tap_init(tap_t *t);
+u32 tap_press(tap_t *t, u32 time, u32 time_hz);
@@ -0,0 +1,194 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// hierarchical timer wheel implementing the libavr32 soft timer interface,
+// built in place of libavr32/src/timers.c. timers are filed by the tick they
+// next expire on so adding, removing and expiring a timer takes constant time
+// regardless of how many timers are running.
+//
+// level 0 has a slot per tick, each slot of the levels above spans all the
+// slots of the level below. a timer sits in the lowest level which covers the
+// distance to its expiry and is cascaded down as the wheel reaches it, timers
+// further out than the top level wait on the overflow list.
+//
+// softTimer_t fields are reused as follows:
+//   ticksRemain - tick the timer next expires on (not a count down)
+//   next, prev  - circular list of the timers in the same slot, NULL when the
+//                 timer is not scheduled
+//
+
+// libavr32
+#include "interrupts.h"
+#include "timers.h"
+
+#define WHEEL_BITS 5
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 3
+#define WHEEL_OVERFLOW (WHEEL_LEVELS * WHEEL_SIZE)
+
+static softTimer_t *slots[WHEEL_OVERFLOW + 1];
+static u32 now;
+
+static softTimer_t **wheel_slot(u32 expiry) {
+  u32 distance = expiry ^ now;
+  for (u8 level = 0; level < WHEEL_LEVELS; level++) {
+    u8 shift = level * WHEEL_BITS;
+    if ((distance >> shift) < WHEEL_SIZE) {
+      return &slots[level * WHEEL_SIZE + ((expiry >> shift) & WHEEL_MASK)];
+    }
+  }
+  return &slots[WHEEL_OVERFLOW];
+}
+
+static void wheel_link(softTimer_t *t) {
+  softTimer_t **slot = wheel_slot(t->ticksRemain);
+  softTimer_t *head = *slot;
+  if (head == NULL) {
+    t->next = t->prev = t;
+    *slot = t;
+  } else {
+    t->next = head;
+    t->prev = head->prev;
+    head->prev->next = t;
+    head->prev = t;
+  }
+}
+
+static void wheel_unlink(softTimer_t *t) {
+  softTimer_t **slot = wheel_slot(t->ticksRemain);
+  if (t->next == t) {
+    *slot = NULL;
+  } else {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    if (*slot == t) {
+      *slot = t->next;
+    }
+  }
+  t->next = t->prev = NULL;
+}
+
+static inline bool wheel_scheduled(softTimer_t *t) {
+  return t->next != NULL;
+}
+
+static void wheel_schedule(softTimer_t *t, u32 expiry) {
+  if (wheel_scheduled(t)) {
+    wheel_unlink(t);
+  }
+  // anything due now or earlier goes off on the next tick
+  t->ticksRemain = (s32)(expiry - now) > 0 ? expiry : now + 1;
+  wheel_link(t);
+}
+
+static void wheel_cascade(softTimer_t **slot) {
+  softTimer_t *t = *slot;
+  *slot = NULL;
+  while (t != NULL) {
+    softTimer_t *next = t->next != t ? t->next : NULL;
+    t->prev->next = t->next; // keep the remainder circular while walking it
+    t->next->prev = t->prev;
+    t->next = t->prev = NULL;
+    wheel_link(t);
+    t = next;
+  }
+}
+
+bool timer_add(softTimer_t *t, u32 ticks, timer_callback_t callback, void *caller) {
+  bool added = false;
+  u8 flags = irqs_pause();
+  if (!wheel_scheduled(t)) {
+    t->ticks = ticks;
+    t->callback = callback;
+    t->caller = caller;
+    wheel_schedule(t, now + ticks);
+    added = true;
+  }
+  irqs_resume(flags);
+  return added;
+}
+
+bool timer_remove(softTimer_t *t) {
+  bool removed = false;
+  u8 flags = irqs_pause();
+  if (wheel_scheduled(t)) {
+    wheel_unlink(t);
+    removed = true;
+  }
+  irqs_resume(flags);
+  return removed;
+}
+
+void timer_set(softTimer_t *t, u32 ticks) {
+  u8 flags = irqs_pause();
+  if (wheel_scheduled(t)) {
+    // keep the ticks already counted toward the current period
+    u32 start = t->ticksRemain - t->ticks;
+    wheel_schedule(t, start + ticks);
+  }
+  t->ticks = ticks;
+  irqs_resume(flags);
+}
+
+void timer_reset(softTimer_t *t) {
+  u8 flags = irqs_pause();
+  if (wheel_scheduled(t)) {
+    wheel_schedule(t, now + t->ticks);
+  }
+  irqs_resume(flags);
+}
+
+void timer_reset_set(softTimer_t *t, u32 ticks) {
+  u8 flags = irqs_pause();
+  t->ticks = ticks;
+  if (wheel_scheduled(t)) {
+    wheel_schedule(t, now + ticks);
+  }
+  irqs_resume(flags);
+}
+
+void timer_manual(softTimer_t *t) {
+  timer_reset(t);
+  (*t->callback)(t->caller);
+}
+
+void timers_clear(void) {
+  u8 flags = irqs_pause();
+  for (u8 i = 0; i <= WHEEL_OVERFLOW; i++) {
+    while (slots[i] != NULL) {
+      wheel_unlink(slots[i]);
+    }
+  }
+  irqs_resume(flags);
+}
+
+// called from the tick interrupt
+void process_timers(void) {
+  now++;
+
+  // move the timers in the slots the wheel has just reached down a level,
+  // highest first so they can fall through more than one level
+  if ((now & ((1 << (WHEEL_LEVELS * WHEEL_BITS)) - 1)) == 0) {
+    wheel_cascade(&slots[WHEEL_OVERFLOW]);
+  }
+  for (u8 level = WHEEL_LEVELS - 1; level > 0; level--) {
+    u8 shift = level * WHEEL_BITS;
+    if ((now & ((1 << shift) - 1)) == 0) {
+      wheel_cascade(&slots[level * WHEEL_SIZE + ((now >> shift) & WHEEL_MASK)]);
+    }
+  }
+
+  // timers are rescheduled before their callback runs so callbacks are free
+  // to change or remove any timer, including their own
+  softTimer_t **slot = &slots[now & WHEEL_MASK];
+  softTimer_t *t;
+  while ((t = *slot) != NULL) {
+    wheel_unlink(t);
+    t->ticksRemain = now + (t->ticks > 0 ? t->ticks : 1);
+    wheel_link(t);
+    (*t->callback)(t->caller);
+  }
+}
@@ -19,6 +19,12 @@
 // step
 //
 
+// gate lengths in phasor ticks, the default (0) matches the original fixed
+// width trigger; longer gates hold across one or more following steps
+const u16 gate_lengths[GATE_LENGTH_COUNT] = {
+    4, 8, 12, 16, 24, 32, 48, 64, 96, 128, 160, 192, 256, 320, 384, 512,
+};
+
 void step_set(step_t *step, u8 voice, u8 value) {
   step->voice[voice].value = value;
   step->voice[voice].enabled = value > 0;
@@ -58,12 +64,18 @@ void step_load(step_t *step, u8 out[VOICE_COUNT]) {
 //
 
 void pattern_init(pattern_t *p) {
-  memset(p, 0, sizeof(track_t));
+  memset(p, 0, sizeof(pattern_t));
   p->length = PATTERN_DEFAULT_LENGTH;
+  p->dirty = 1;
 }
 
 void pattern_copy(pattern_t *dst, pattern_t *src) {
   memcpy(dst, src, sizeof(pattern_t));
+  dst->dirty = 1;
+}
+
+void pattern_set_dirty(pattern_t *p) {
+  p->dirty = 1;
 }
 
 //
@@ -113,16 +125,22 @@ void track_view_steps(track_view_t *v, u8 top_row, bool show_playhead) {
     monomeFrameDirty++;
   }
 
-  // playhead
   if (show_playhead) {
-    u8 l = playhead_position(v->playhead);
-    if (l >= view_start && l < view_start + PAGE_SIZE) {
-      l -= view_start;
-      for (u8 v = 0; v < VOICE_COUNT; v++) {
-        monomeLedBuffer[top_offset + (v * GRID_WIDTH) + l] += L2;
-      }
-      monomeFrameDirty++;
+    track_view_playhead(v, top_row);
+  }
+}
+
+void track_view_playhead(track_view_t *v, u8 top_row) {
+  u8 view_start = v->page * PAGE_SIZE;
+  u8 top_offset = top_row * GRID_WIDTH;
+
+  u8 l = playhead_position(v->playhead);
+  if (l >= view_start && l < view_start + PAGE_SIZE) {
+    l -= view_start;
+    for (u8 v = 0; v < VOICE_COUNT; v++) {
+      monomeLedBuffer[top_offset + (v * GRID_WIDTH) + l] += L2;
     }
+    monomeFrameDirty++;
   }
 }
 
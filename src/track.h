@@ -24,15 +24,27 @@ typedef enum { cueNone = 0, cuePattern, cueMeta } cue_mode_t;
 // step
 //
 
+typedef enum { condAlways = 0, condChance, condEvery, condFill } condition_t;
+
+// packed into 3 bytes, there are GRID_NUM_PATTERNS * PATTERN_STEP_MAX *
+// VOICE_COUNT of these in the working preset
 typedef struct {
   u8 selected : 1;
   u8 enabled : 1;
-  u8 reserved : 6;
-  s8 timing;
-  u8 value;
-  // TODO: condition
+  u8 condition : 2;     // condition_t deciding if the trig plays
+  u8 condition_arg : 4; // chance in 16ths (less one), every_n_of_m index, or not fill
+  s8 timing : 6;        // ticks from the middle of the step [-MID_PHASE, MID_PHASE]
+  u8 value : 2;         // [0-3], 0 is unset
+  u8 length : 4;        // gate length, index into gate_lengths
+  u8 ratchet : 3;       // additional hits within the step [0-RATCHET_MAX)
+  u8 spacing : 1;       // hits are spread over a full (0) or half (1) step
 } trig_t;
 
+#define GATE_LENGTH_COUNT 16
+#define RATCHET_MAX 8
+
+extern const u16 gate_lengths[GATE_LENGTH_COUNT];
+
 typedef struct {
   u8 flags;
   trig_t voice[VOICE_COUNT];
@@ -52,11 +64,13 @@ typedef struct {
   step_t step[PATTERN_STEP_MAX];
   u8 length;
   u8 occupied : 1;
-  u8 reserved : 7;
+  u8 dirty : 1; // edited since the schedule was last compiled
+  u8 reserved : 6;
 } pattern_t;
 
 void pattern_init(pattern_t *p);
 void pattern_copy(pattern_t *dst, pattern_t *src);
+void pattern_set_dirty(pattern_t *p);
 
 //
 // track
@@ -65,6 +79,8 @@ void pattern_copy(pattern_t *dst, pattern_t *src);
 typedef struct {
   cue_mode_t cue;
   u8 pattern;
+  u8 groove; // groove template applied to the track's steps [0-GROOVE_COUNT)
+  s8 swing;  // ticks odd steps are pushed late by [0-MID_PHASE]
 } track_t;
 
 void track_init(track_t *t, u8 initial_pattern);
@@ -85,5 +101,6 @@ typedef struct {
 
 void track_view_init(track_view_t *v, track_t *t, playhead_t *p, pattern_t *patterns);
 void track_view_steps(track_view_t *v, u8 top_row, bool show_playhead);
+void track_view_playhead(track_view_t *v, u8 top_row);
 void track_view_length(track_view_t *v, u8 top_row);
 pattern_t *track_view_pattern(track_view_t *v);
\ No newline at end of file
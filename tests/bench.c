@@ -0,0 +1,180 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// tick throughput of the phasor callbacks. each engine is driven through
+// BENCH_TICKS phasor ticks twice, once untimed for the mean cost of a tick and
+// once timing every step boundary (phase 0) on its own. the worst case is
+// mostly the host preempting the run, the 99th percentile is the figure to
+// compare.
+//
+// the "scan" rows run the same grid patterns through the reference engine,
+// build_waves() each step and a cursor scan of every output each tick. it has
+// no ratchets or gate lengths so its dense row does less work than grid's.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// this
+#include "main.h"
+#include "mode_common.h"
+#include "ref_grid.h"
+#include "sim.h"
+#include "track.h"
+
+#define BENCH_TICKS 4000000
+#define BENCH_STEPS (BENCH_TICKS / PPQ)
+
+typedef struct {
+  const char *name;
+  void (*setup)(void);
+  phasor_callback_t *tick; // defaults to the callback the mode installed
+} bench_t;
+
+static u64 clock_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static u32 step_ns[BENCH_STEPS];
+
+static int compare_u32(const void *a, const void *b) {
+  u32 x = *(const u32 *)a, y = *(const u32 *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void grid_patterns(bool dense) {
+  sim_init();
+  sim_fresh_flash();
+
+  // the two tracks default to patterns 0 and 12 of the first preset
+  preset_t *preset = sim_grid_preset(0);
+  u8 patterns[GRID_NUM_TRACKS] = {0, 12};
+  for (u8 i = 0; i < GRID_NUM_TRACKS; i++) {
+    pattern_t *pat = &preset->pattern[patterns[i]];
+    for (u8 s = 0; s < PATTERN_DEFAULT_LENGTH; s++) {
+      for (u8 v = 0; v < VOICE_COUNT; v++) {
+        if (dense || (v == 0 && (s & 3) == 0)) {
+          step_set(&pat->step[s], v, 1);
+        }
+        if (dense) {
+          // every voice ratchets and holds across into the next step
+          trig_t *t = &pat->step[s].voice[v];
+          t->ratchet = 3;
+          t->length = 7;
+          t->timing = (s * 7 + v * 3) % 31 - 15;
+        }
+      }
+    }
+  }
+
+  init_grid();
+  enter_mode_grid();
+}
+
+static void grid_dense(void) {
+  grid_patterns(true);
+}
+
+static void grid_sparse(void) {
+  grid_patterns(false);
+}
+
+static void scan_patterns(bool dense) {
+  grid_patterns(dense);
+  leave_mode_grid();
+  preset_t *preset = sim_grid_preset(0);
+  ref_grid_init(&preset->pattern[0], &preset->pattern[12]);
+}
+
+static void scan_dense(void) {
+  scan_patterns(true);
+}
+
+static void scan_sparse(void) {
+  scan_patterns(false);
+}
+
+static void scan_tick(u8 now, bool reset) {
+  ref_grid_tick(now);
+}
+
+static void arc_default(void) {
+  sim_init();
+  sim_fresh_flash();
+  connected = conARC;
+  init_arc();
+  enter_mode_arc();
+}
+
+static void div_default(void) {
+  sim_init();
+  sim_fresh_flash();
+  init_div();
+  enter_mode_div();
+  // div starts paused, front short starts it
+  sim_event(kEventFrontShort, 0);
+}
+
+static const bench_t benches[] = {
+    {"scan dense", &scan_dense, &scan_tick},
+    {"grid dense", &grid_dense, NULL},
+    {"scan sparse", &scan_sparse, &scan_tick},
+    {"grid sparse", &grid_sparse, NULL},
+    {"arc", &arc_default, NULL},
+    {"div", &div_default, NULL},
+};
+
+static void run(const bench_t *b) {
+  u64 start, step_total = 0, step_worst = 0;
+  u32 steps = 0;
+  u32 i;
+
+  b->setup();
+  phasor_callback_t *cb = b->tick ? b->tick : sim_phasor;
+
+  start = clock_ns();
+  for (i = 0; i < BENCH_TICKS; i++) {
+    (*cb)(i & (PPQ - 1), false);
+  }
+  double per_tick = (double)(clock_ns() - start) / BENCH_TICKS;
+
+  b->setup();
+  for (i = 0; i < BENCH_TICKS; i++) {
+    u8 now = i & (PPQ - 1);
+    if (now == MIN_PHASE) {
+      start = clock_ns();
+      (*cb)(now, false);
+      u64 ns = clock_ns() - start;
+      step_total += ns;
+      step_ns[steps++] = ns;
+      if (ns > step_worst) {
+        step_worst = ns;
+      }
+    } else {
+      (*cb)(now, false);
+    }
+  }
+
+  qsort(step_ns, steps, sizeof(step_ns[0]), compare_u32);
+  printf("%-12s %9.1f %13.1f %12u %14llu\n", b->name, per_tick, (double)step_total / steps,
+         step_ns[steps * 99 / 100], (unsigned long long)step_worst);
+}
+
+int main(void) {
+  printf("%d ticks per run, times include ~%u ns of clock_gettime per step\n", BENCH_TICKS,
+         (unsigned)({
+           u64 a = clock_ns();
+           clock_ns() - a;
+         }));
+  printf("%-12s %9s %13s %12s %14s\n", "engine", "ns/tick", "step mean ns", "step p99 ns",
+         "step worst ns");
+  for (u8 i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+    run(&benches[i]);
+  }
+  return 0;
+}
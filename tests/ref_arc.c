@@ -0,0 +1,244 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// libavr32
+#include "mailbox.h"
+#include "util.h"
+
+// this
+#include "mode_common.h"
+#include "ref_arc.h"
+
+typedef enum {
+  uiPlay,
+  uiConfig,
+} ui_mode_t;
+
+typedef struct {
+  u16 phase;  // ticks before beginning cycle
+  u16 width;  // width of gate in ticks
+  u16 period; // ticks cycle
+} gate_t;
+
+typedef struct {
+  u8 divisor;
+  bool selected;
+
+  gate_t base;
+  gate_t effective; // factoring in divisor
+
+  mailbox_t divisor_change;
+
+  u16 now; // local tick count [0-effective.period)
+  bool fired;
+} output_t;
+
+static const uint8_t delta_acc[16] = {0,  1,  3,  6,  10, 15, 21,  28,
+                                      36, 45, 55, 66, 78, 91, 105, 120};
+
+static s32 enc_acc[2];
+static output_t output[8];
+static u8 selection;
+static ui_mode_t ui_mode;
+static u8 tr;
+
+static void set_tr(u8 n) {
+  tr |= 1 << n;
+}
+
+static void clr_tr(u8 n) {
+  tr &= ~(1 << n);
+}
+
+static void set_output_divisor(u8 n, u8 divisor) {
+  output[n].divisor = uclip(divisor, 1, MAX_DIVISOR);
+}
+
+static void calc_effective_divisor(u8 n) {
+  u8 d = output[n].divisor;
+  output[n].effective.phase = output[n].base.phase * d;
+  output[n].effective.width = output[n].base.width * d;
+  output[n].effective.period = output[n].base.period * d;
+}
+
+static void set_output_phase(u8 n, u16 phase) {
+  u16 t = uclip(phase, 0, MAX_PHASE);
+  output[n].base.phase = t;
+  output[n].effective.phase = t * output[n].divisor;
+}
+
+static void set_output_width(u8 n, u16 width) {
+  u16 t = uclip(width, 1, MAX_WIDTH);
+  output[n].base.width = t;
+  output[n].effective.width = t * output[n].divisor;
+}
+
+static void set_output_period(u8 n, u16 period) {
+  u16 t = uclip(period, 1, MAX_PERIOD);
+  output[n].base.period = t;
+  output[n].effective.period = t * output[n].divisor;
+}
+
+static void reset_output(u8 n) {
+  clr_tr(n);
+  mailbox_init(&output[n].divisor_change);
+  output[n].divisor = 1;
+  output[n].selected = false;
+  set_output_phase(n, 0);
+  set_output_width(n, MAX_WIDTH >> 1);
+  set_output_period(n, MAX_PERIOD);
+  output[n].now = 0;
+  output[n].fired = false;
+}
+
+static void enc_set_acc_play(u8 selection) {
+  enc_acc[0] = output[selection].base.phase << 7;
+  enc_acc[1] = output[selection].base.width << 7;
+}
+
+static void enc_set_acc_config(u8 selection) {
+  enc_acc[1] = output[selection].divisor << 7;
+}
+
+void ref_arc_init(void) {
+  tr = 0;
+  selection = 0;
+  ui_mode = uiPlay;
+  for (u8 i = 0; i < 8; i++) {
+    reset_output(i);
+  }
+
+  // the defaults init_arc() sets up
+  set_output_phase(1, 16);
+  set_output_width(1, 16);
+
+  set_output_divisor(2, 2);
+  calc_effective_divisor(2);
+  set_output_divisor(3, 2);
+  calc_effective_divisor(3);
+  set_output_phase(3, 32);
+  set_output_width(3, 16);
+
+  set_output_divisor(4, 3);
+  calc_effective_divisor(4);
+  set_output_divisor(5, 3);
+  calc_effective_divisor(5);
+  set_output_phase(5, 48);
+  set_output_width(5, 8);
+
+  set_output_divisor(6, 4);
+  calc_effective_divisor(6);
+  set_output_divisor(7, 5);
+  calc_effective_divisor(7);
+  set_output_phase(7, 8);
+  set_output_width(7, 48);
+}
+
+void ref_arc_tick(u8 now, bool reset) {
+  message_t msg;
+  u8 i;
+  s32 n;
+
+  // sync all
+  if (reset) {
+    for (i = 0; i < 8; i++) {
+      clr_tr(i);
+      output[i].now = now * output[i].divisor;
+      output[i].fired = false;
+    }
+  }
+
+  if (now == 0) {
+    // apply queued division changes at base phasor cycle start
+    for (i = 0; i < 8; i++) {
+      if (mailbox_get(&output[i].divisor_change, &msg)) {
+        calc_effective_divisor(i);
+      }
+    }
+  }
+
+  for (i = 0; i < 8; i++) {
+    n = output[i].now - output[i].effective.phase;
+    if (n < 0) {
+      n = output[i].effective.period + n;
+    }
+
+    if (!output[i].fired && (n < output[i].effective.width)) {
+      set_tr(i);
+      output[i].fired = true;
+    } else if (output[i].fired && (n >= output[i].effective.width)) {
+      clr_tr(i);
+      output[i].fired = false;
+    }
+
+    output[i].now++;
+    if (output[i].now >= output[i].effective.period) {
+      output[i].now = 0;
+    }
+  }
+}
+
+u8 ref_arc_tr(void) {
+  return tr;
+}
+
+void ref_arc_knob(u8 p) {
+  selection = p;
+  if (ui_mode == uiPlay) {
+    enc_set_acc_play(selection);
+  } else {
+    enc_set_acc_config(selection);
+  }
+}
+
+void ref_arc_front_short(void) {
+  if (ui_mode == uiPlay) {
+    output[selection].selected = !output[selection].selected;
+  } else {
+    enc_set_acc_play(selection);
+    ui_mode = uiPlay;
+  }
+}
+
+void ref_arc_front_long(void) {
+  enc_set_acc_config(selection);
+  ui_mode = uiConfig;
+}
+
+void ref_arc_enc(u8 n, s8 delta) {
+  message_t msg;
+  s16 t;
+  u8 d;
+
+  if (n > 1) {
+    return;
+  }
+
+  delta = sclip(delta, -15, 15);
+  delta = delta > 0 ? delta_acc[delta] : -delta_acc[-delta];
+
+  if (ui_mode == uiPlay) {
+    enc_acc[n] = sclip(enc_acc[n] + delta, 0, PPQ << 7);
+    t = sclip(enc_acc[n] >> 7, 0, PPQ);
+    if (n == 0 && t != output[selection].base.phase) {
+      set_output_phase(selection, t);
+    } else if (n == 1 && t != output[selection].base.width) {
+      set_output_width(selection, t);
+    }
+  } else if (n == 1) {
+    // encoder 0 sets the clock, which only changes the tick rate
+    enc_acc[n] = sclip(enc_acc[n] + delta, 1 << 7, 16 << 7);
+    d = enc_acc[1] >> 7;
+    for (u8 i = 0; i < 8; i++) {
+      if (i == selection || output[i].selected) {
+        set_output_divisor(i, d);
+        msg.which = i;
+        msg.data = d;
+        mailbox_post(&output[i].divisor_change, &msg, kPostReplace);
+      }
+    }
+  }
+}
@@ -0,0 +1,29 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+// libavr32
+#include "types.h"
+
+//
+// reference arc engine
+//
+// arc mode's outputs as they were before the edge scheduler: every output
+// counts its own ticks and compares against phase and width on each phasor
+// tick. the knob, front button and encoder handling which edits the outputs
+// is carried over too (less the clock) so the same input can be fed to both.
+// outputs are a mask, like sim_tr.
+//
+
+void ref_arc_init(void);
+void ref_arc_tick(u8 now, bool reset);
+u8 ref_arc_tr(void);
+
+void ref_arc_knob(u8 selection);
+void ref_arc_front_short(void);
+void ref_arc_front_long(void);
+void ref_arc_enc(u8 n, s8 delta);
@@ -0,0 +1,123 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// asf
+#include "string.h"
+
+// libavr32
+#include "phasor.h"
+
+// this
+#include "mode_common.h"
+#include "playhead.h"
+#include "ref_grid.h"
+#include "schedule.h"
+
+#define REF_WAVE_EDGES 8
+#define REF_NUM_OUTPUTS 8
+#define REF_NUM_TRACKS 2
+
+typedef struct {
+  edge_t edges[REF_WAVE_EDGES]; // offsets in phaser ramp where level transition should occur
+  u8 cursor;                     // index of next edge
+} waveform_t;
+
+static pattern_t *patterns[REF_NUM_TRACKS];
+static playhead_t playhead[REF_NUM_TRACKS];
+static waveform_t waves[REF_NUM_OUTPUTS];
+static edge_t carry[REF_NUM_OUTPUTS];
+static u8 tr;
+
+inline static u16 edge_pack(u8 level, u8 offset) {
+  edge_t e = {.f = {.set = 1, .level = level, .offset = offset}};
+  return e.v;
+}
+
+static void build_waves(void) {
+  memset(&waves, 0, sizeof(waves));
+
+  u8 wn = 0;
+  for (u8 tn = 0; tn < REF_NUM_TRACKS; tn++) {
+    u8 sn = playhead_position(&playhead[tn]);
+
+    for (u8 v = 0; v < VOICE_COUNT; v++) {
+      u8 edge_idx = 0;
+      // add falling edge for gates which are high at the end of the previous phasor cycle
+      if (carry[wn].f.set) {
+        waves[wn].edges[edge_idx].v = carry[wn].v;
+        carry[wn].v = 0; // clear the carry so we don't repeat
+      }
+
+      trig_t t = patterns[tn]->step[sn].voice[v];
+
+      if (t.enabled && t.value) {
+        // determine rise
+        u8 rise = MID_PHASE + t.timing;
+        if (waves[wn].edges[edge_idx].f.set) {
+          if (rise > waves[wn].edges[edge_idx].f.offset) {
+            // only add a trigger if lands after the previous, otherwise tie
+            ++edge_idx;
+            waves[wn].edges[edge_idx++].v = edge_pack(1, rise);
+          } else {
+            // rise comes before previous fall, erase previous fall
+            waves[wn].edges[edge_idx].v = 0;
+          }
+        } else {
+          waves[wn].edges[edge_idx++].v = edge_pack(1, rise);
+        }
+
+        // determine fall, a fall at exactly PPQ is never reached
+        u8 fall = rise + 4;
+        if (fall > PPQ) {
+          carry[wn].v = edge_pack(0, fall - PPQ);
+        } else {
+          waves[wn].edges[edge_idx++].v = edge_pack(0, fall);
+        }
+      }
+      wn++;
+    }
+
+    // extra to skip over 4th tr
+    wn++;
+  }
+}
+
+void ref_grid_init(pattern_t *track1, pattern_t *track2) {
+  patterns[0] = track1;
+  patterns[1] = track2;
+  for (u8 tn = 0; tn < REF_NUM_TRACKS; tn++) {
+    // as track_view_init() does, playheads wrap at the pattern length
+    playhead_init(&playhead[tn]);
+    playhead[tn].max = patterns[tn]->length;
+  }
+  memset(&waves, 0, sizeof(waves));
+  memset(&carry, 0, sizeof(carry));
+  tr = 0;
+}
+
+void ref_grid_tick(u8 now) {
+  if (now == MIN_PHASE) {
+    playhead_advance(&playhead[0]);
+    playhead_advance(&playhead[1]);
+    build_waves();
+  }
+
+  for (u8 wn = 0; wn < REF_NUM_OUTPUTS; wn++) {
+    edge_t edge = waves[wn].edges[waves[wn].cursor];
+    if (edge.f.set && edge.f.offset == now) {
+      if (edge.f.level) {
+        tr |= 1 << wn;
+      } else {
+        tr &= ~(1 << wn);
+      }
+      waves[wn].cursor++;
+    }
+  }
+}
+
+u8 ref_grid_tr(void) {
+  return tr;
+}
@@ -0,0 +1,25 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+// libavr32
+#include "types.h"
+
+// this
+#include "track.h"
+
+//
+// reference grid engine
+//
+// the waveform build and per tick scan grid mode used before the schedule,
+// kept so the compiled schedule can be checked against it and the two timed
+// side by side. outputs are a mask in mode order, like sim_tr.
+//
+
+void ref_grid_init(pattern_t *track1, pattern_t *track2);
+void ref_grid_tick(u8 now);
+u8 ref_grid_tr(void);
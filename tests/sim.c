@@ -0,0 +1,370 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include <stdio.h>
+#include <string.h>
+
+// asf
+#include "conf_board.h"
+#include "gpio.h"
+#include "print_funcs.h"
+
+// libavr32
+#include "events.h"
+#include "flashc.h"
+#include "i2c.h"
+#include "interrupts.h"
+#include "mailbox.h"
+#include "monome.h"
+#include "phasor.h"
+#include "util.h"
+
+// this
+#include "main.h"
+#include "sim.h"
+
+u32 sim_cycles;
+u8 sim_tr;
+bool sim_clock;
+u16 sim_knob;
+bool sim_verbose;
+
+phasor_callback_t *sim_phasor;
+u16 sim_phasor_hz;
+bool sim_reset;
+
+static u8 phasor_divisions;
+static u8 phasor_count;
+static bool phasor_running;
+static bool phasor_reset_pending;
+static u64 phasor_next; // time of the next tick in 1/65536 cycles
+
+////////////////////////////////////////////////////////////////////////////////
+// main.c
+
+// f is const so it would land in .rodata, the simulated flash is written to.
+// naming .data itself makes the assembler warn about the section flags, a
+// .data.* section gets the const flags but is linked into writable .data.
+__attribute__((section(".data.sim_flash"))) nvram_data_t f;
+
+connected_t connected;
+bool external_clock;
+u16 adc[4];
+u16 (*clock_input)(u8 level) = &clock_input_null;
+
+#define SIM_CLOCK_EDGES 32
+static clock_edge_t clock_edges[SIM_CLOCK_EDGES];
+static u8 clock_edge_next;
+
+void handler_None(s32 data) {
+}
+
+u16 poll_knob(void) {
+  return sim_knob;
+}
+
+u32 front_press_time(void) {
+  return sim_cycles;
+}
+
+u16 clock_input_null(u8 level) {
+  return 0;
+}
+
+const clock_edge_t *clock_edge(s32 data) {
+  return &clock_edges[data % SIM_CLOCK_EDGES];
+}
+
+void set_tr(uint8_t n) {
+  sim_tr |= 1 << n;
+}
+
+void clr_tr(uint8_t n) {
+  sim_tr &= ~(1 << n);
+}
+
+void set_tr_mask(uint8_t set, uint8_t clr) {
+  sim_tr = (sim_tr & ~clr) | set;
+}
+
+void clr_tr_all(void) {
+  sim_tr = 0;
+}
+
+uint8_t get_tr(uint8_t n) {
+  return (sim_tr >> n) & 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// libavr32
+
+void (*app_event_handlers[kNumEventTypes])(s32 data);
+void (*process_ii)(uint8_t *d, uint8_t l);
+
+u8 monomeLedBuffer[MONOME_MAX_LED_BYTES];
+u8 monomeFrameDirty;
+
+static void monome_refresh_null(void) {
+}
+
+void (*monome_refresh)(void) = &monome_refresh_null;
+
+// the shared queue, as libavr32 events.c without the interrupt masking
+#define SIM_EVENTS 40 // MAX_EVENTS
+static event_t sim_events[SIM_EVENTS];
+static u8 sim_events_head;
+static u8 sim_events_count;
+
+u8 event_post(event_t *e) {
+  if (sim_events_count == SIM_EVENTS) {
+    return 0;
+  }
+  sim_events[(sim_events_head + sim_events_count) % SIM_EVENTS] = *e;
+  sim_events_count++;
+  return 1;
+}
+
+u8 event_next(event_t *e) {
+  if (sim_events_count == 0) {
+    return 0;
+  }
+  *e = sim_events[sim_events_head];
+  sim_events_head = (sim_events_head + 1) % SIM_EVENTS;
+  sim_events_count--;
+  return 1;
+}
+
+void print_dbg(const char *str) {
+  if (sim_verbose) {
+    fputs(str, stdout);
+  }
+}
+
+void print_dbg_ulong(unsigned long n) {
+  if (sim_verbose) {
+    printf("%lu", n);
+  }
+}
+
+void print_dbg_hex(unsigned long n) {
+  if (sim_verbose) {
+    printf("%08lx", n);
+  }
+}
+
+u8 irqs_pause(void) {
+  return 0;
+}
+
+void irqs_resume(u8 flags) {
+}
+
+void gpio_set_gpio_pin(u32 pin) {
+  if (pin == B10) {
+    sim_clock = true;
+  }
+}
+
+void gpio_clr_gpio_pin(u32 pin) {
+  if (pin == B10) {
+    sim_clock = false;
+  }
+}
+
+int gpio_get_pin_value(u32 pin) {
+  // jacks unpatched, front button up
+  return 1;
+}
+
+void flashc_memset8(volatile void *dst, u8 src, size_t nbytes, bool erase) {
+  memset((void *)dst, src, nbytes);
+}
+
+void flashc_memset16(volatile void *dst, u16 src, size_t nbytes, bool erase) {
+  for (size_t i = 0; i < nbytes; i += 2) {
+    memcpy((u8 *)dst + i, &src, nbytes - i < 2 ? nbytes - i : 2);
+  }
+}
+
+void flashc_memset32(volatile void *dst, u32 src, size_t nbytes, bool erase) {
+  for (size_t i = 0; i < nbytes; i += 4) {
+    memcpy((u8 *)dst + i, &src, nbytes - i < 4 ? nbytes - i : 4);
+  }
+}
+
+void flashc_memcpy(volatile void *dst, const void *src, size_t nbytes, bool erase) {
+  memcpy((void *)dst, src, nbytes);
+}
+
+s32 sclip(s32 a, s32 low, s32 high) {
+  return a < low ? low : (a > high ? high : a);
+}
+
+u32 uclip(u32 a, u32 low, u32 high) {
+  return a < low ? low : (a > high ? high : a);
+}
+
+void mailbox_init(mailbox_t *m) {
+  m->full = false;
+}
+
+bool mailbox_post(mailbox_t *m, message_t *msg, mailbox_post_t mode) {
+  if (m->full && mode != kPostReplace) {
+    return false;
+  }
+  m->message = *msg;
+  m->full = true;
+  return true;
+}
+
+bool mailbox_get(mailbox_t *m, message_t *msg) {
+  if (!m->full) {
+    return false;
+  }
+  *msg = m->message;
+  m->full = false;
+  return true;
+}
+
+u8 monome_xy_idx(u8 x, u8 y) {
+  return x | (y << 4);
+}
+
+void monome_grid_key_parse_event_data(s32 data, u8 *x, u8 *y, u8 *z) {
+  *x = data & 0xff;
+  *y = (data >> 8) & 0xff;
+  *z = (data >> 16) & 0xff;
+}
+
+void monome_ring_enc_parse_event_data(s32 data, u8 *n, s8 *delta) {
+  *n = data & 0xff;
+  *delta = (s8)((data >> 8) & 0xff);
+}
+
+//
+// phasor, ticks are spaced by FMCK_HZ / hz cycles. a reset restarts the tick
+// period and the next callback is at phase 0 with reset set.
+//
+
+static u64 phasor_period(void) {
+  return ((u64)FMCK_HZ << 16) / (sim_phasor_hz ? sim_phasor_hz : 1);
+}
+
+void phasor_set_callback(phasor_callback_t *cb) {
+  sim_phasor = cb;
+}
+
+void phasor_setup(u16 hz, u8 divisions) {
+  sim_phasor_hz = hz;
+  phasor_divisions = divisions;
+  phasor_count = 0;
+  phasor_reset_pending = false;
+}
+
+void phasor_start(void) {
+  phasor_running = true;
+  phasor_next = ((u64)sim_cycles << 16) + phasor_period();
+}
+
+void phasor_stop(void) {
+  phasor_running = false;
+}
+
+void phasor_reset(void) {
+  phasor_count = 0;
+  phasor_reset_pending = true;
+  phasor_next = ((u64)sim_cycles << 16) + phasor_period();
+}
+
+u16 phasor_set_frequency(u16 hz) {
+  sim_phasor_hz = hz;
+  return hz;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// sim
+
+void sim_init(void) {
+  sim_cycles = 0;
+  sim_tr = 0;
+  sim_clock = false;
+  sim_knob = 0;
+  sim_phasor = NULL;
+  phasor_running = false;
+  connected = conNONE;
+  external_clock = false;
+  clock_input = &clock_input_null;
+  sim_events_head = 0;
+  sim_events_count = 0;
+  for (u8 i = 0; i < kNumEventTypes; i++) {
+    app_event_handlers[i] = &handler_None;
+  }
+}
+
+void sim_fresh_flash(void) {
+  memset((void *)&f, 0, sizeof(f));
+  default_grid();
+  default_arc();
+  default_div();
+}
+
+preset_t *sim_grid_preset(u8 n) {
+  return (preset_t *)&f.grid_state.p[n];
+}
+
+u8 sim_tick(void) {
+  u8 now = phasor_count;
+  bool reset = phasor_reset_pending;
+
+  u64 due = phasor_next;
+
+  sim_cycles = due >> 16;
+  phasor_reset_pending = false;
+  sim_reset = reset;
+  phasor_count = (phasor_count + 1) % phasor_divisions;
+  if (sim_phasor) {
+    (*sim_phasor)(now, reset);
+  }
+  // as with the timer compare a rate set by the callback applies to the
+  // period which starts here, unless the callback restarted the phasor
+  if (phasor_next == due) {
+    phasor_next += phasor_period();
+  }
+  return now;
+}
+
+void sim_run_until(u32 time) {
+  while (phasor_running && (s32)((u32)(phasor_next >> 16) - time) <= 0) {
+    sim_tick();
+  }
+  sim_cycles = time;
+}
+
+u32 sim_tick_due(void) {
+  return (u32)(phasor_next >> 16) - sim_cycles;
+}
+
+void sim_event(etype type, s32 data) {
+  (*app_event_handlers[type])(data);
+}
+
+void sim_grid_key(u8 x, u8 y, u8 z) {
+  sim_event(kEventMonomeGridKey, x | (y << 8) | (z << 16));
+}
+
+s32 sim_clock_input(u8 level) {
+  u8 slot = clock_edge_next;
+  clock_edge_t *e = &clock_edges[slot];
+  e->time = sim_cycles;
+  e->level = level;
+  e->tick = (*clock_input)(level);
+  clock_edge_next = (slot + 1) % SIM_CLOCK_EDGES;
+  return slot;
+}
+
+void sim_ring_enc(u8 n, s8 delta) {
+  sim_event(kEventMonomeRingEnc, n | ((u8)delta << 8));
+}
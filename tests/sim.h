@@ -0,0 +1,55 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#pragma once
+
+// libavr32
+#include "events.h"
+#include "phasor.h"
+#include "types.h"
+
+// this
+#include "mode_grid.h"
+
+//
+// host simulation
+//
+// stands in for main.c and the libavr32 drivers so the mode engines can be
+// run without hardware. time is the simulated cycle counter (sim_cycles at
+// FMCK_HZ), the phasor fires its callback at the rate the mode last set and
+// the trigger outputs are a mask in mode order (before the pin mapping).
+//
+
+extern u32 sim_cycles;  // Get_sys_count()
+extern u8 sim_tr;       // trigger output levels, bit n is tr n
+extern bool sim_clock;  // clock output (B10) level
+extern u16 sim_knob;    // value returned by poll_knob
+extern bool sim_verbose; // pass print_dbg through to stdout
+
+extern phasor_callback_t *sim_phasor;
+extern u16 sim_phasor_hz;
+extern bool sim_reset; // reset flag passed with the last tick
+
+void sim_init(void);
+void sim_fresh_flash(void);
+// a grid preset in flash to edit before init_grid. f is const to callers, so
+// edits through a pointer the caller took from f itself can be dropped.
+preset_t *sim_grid_preset(u8 n);
+
+// runs the phasor callback for every tick due up to (and including) time
+void sim_run_until(u32 time);
+// runs the next phasor tick, returns the phase it was called with
+u8 sim_tick(void);
+// cycles until the next phasor tick
+u32 sim_tick_due(void);
+
+void sim_event(etype type, s32 data);
+void sim_grid_key(u8 x, u8 y, u8 z);
+void sim_ring_enc(u8 n, s8 delta);
+
+// takes a clock input edge at the current time as the interrupt does, returns
+// the data for the kEventClockExt event (which is left to the caller to post)
+s32 sim_clock_input(u8 level);
@@ -0,0 +1,24 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// host stand-in for the libavr32 / asf header of the same name
+
+#pragma once
+
+#define B00 32
+#define B01 33
+#define B02 34
+#define B03 35
+#define B04 36
+#define B05 37
+#define B06 38
+#define B07 39
+#define B08 40
+#define B09 41
+#define B10 42
+#define NMI 13
+
+#define FMCK_HZ 60000000
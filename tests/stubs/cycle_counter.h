@@ -0,0 +1,16 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// host stand-in for the libavr32 / asf header of the same name
+
+#pragma once
+
+#include "types.h"
+
+// the simulated cycle counter, advanced by the host phasor (see sim.h)
+extern u32 sim_cycles;
+
+#define Get_sys_count() (sim_cycles)
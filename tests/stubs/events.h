@@ -0,0 +1,49 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// host stand-in for the libavr32 / asf header of the same name
+
+#pragma once
+
+#include "types.h"
+
+typedef enum {
+  kEventFront,
+  kEventFrontShort,
+  kEventFrontLong,
+  kEventPollADC,
+  kEventKeyTimer,
+  kEventSaveFlash,
+  kEventFtdiConnect,
+  kEventFtdiDisconnect,
+  kEventMonomeConnect,
+  kEventMonomeDisconnect,
+  kEventMonomePoll,
+  kEventMonomeRefresh,
+  kEventMonomeGridKey,
+  kEventMonomeRingEnc,
+  kEventClockNormal,
+  kEventClockExt,
+  kEventMidiConnect,
+  kEventMidiDisconnect,
+  kEventMidiPacket,
+  kEventSerialConnect,
+  kEventSerialDisconnect,
+  kEventTr,
+  kEventTrNormal,
+  kNumEventTypes
+} etype;
+
+typedef struct {
+  etype type;
+  s32 data;
+} event_t;
+
+extern void (*app_event_handlers[])(s32 data);
+
+u8 event_post(event_t *e);
+u8 event_next(event_t *e);
+void init_events(void);
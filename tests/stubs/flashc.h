@@ -0,0 +1,16 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// host stand-in for the libavr32 / asf header of the same name
+
+#pragma once
+
+#include "types.h"
+
+void flashc_memset8(volatile void *dst, u8 src, size_t nbytes, bool erase);
+void flashc_memset16(volatile void *dst, u16 src, size_t nbytes, bool erase);
+void flashc_memset32(volatile void *dst, u32 src, size_t nbytes, bool erase);
+void flashc_memcpy(volatile void *dst, const void *src, size_t nbytes, bool erase);
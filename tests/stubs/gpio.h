@@ -0,0 +1,16 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// host stand-in for the libavr32 / asf header of the same name
+
+#pragma once
+
+#include "conf_board.h"
+#include "types.h"
+
+void gpio_set_gpio_pin(u32 pin);
+void gpio_clr_gpio_pin(u32 pin);
+int gpio_get_pin_value(u32 pin);
@@ -0,0 +1,13 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// host stand-in for the libavr32 / asf header of the same name
+
+#pragma once
+
+#include "types.h"
+
+extern void (*process_ii)(uint8_t *d, uint8_t l);
@@ -0,0 +1,15 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// host stand-in for the libavr32 / asf header of the same name
+
+#pragma once
+
+#include "types.h"
+
+// the host has nothing to mask, callbacks only run when the test calls them
+u8 irqs_pause(void);
+void irqs_resume(u8 flags);
@@ -0,0 +1,25 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// host stand-in for the libavr32 / asf header of the same name
+
+#pragma once
+
+#include <stdint.h>
+
+typedef int32_t fix16_t;
+
+static const fix16_t fix16_one = 0x00010000;
+
+#define F16(x) ((fix16_t)(((x) >= 0) ? ((x)*65536.0 + 0.5) : ((x)*65536.0 - 0.5)))
+
+static inline fix16_t fix16_from_int(int a) {
+  return a * fix16_one;
+}
+
+static inline int fix16_to_int(fix16_t a) {
+  return a >= 0 ? (a + (fix16_one >> 1)) / fix16_one : (a - (fix16_one >> 1)) / fix16_one;
+}
@@ -0,0 +1,27 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// host stand-in for the libavr32 / asf header of the same name
+
+#pragma once
+
+#include "types.h"
+
+typedef struct {
+  u8 which;
+  s32 data;
+} message_t;
+
+typedef struct {
+  message_t message;
+  bool full;
+} mailbox_t;
+
+typedef enum { kPostReplace, kPostNoReplace } mailbox_post_t;
+
+void mailbox_init(mailbox_t *m);
+bool mailbox_post(mailbox_t *m, message_t *msg, mailbox_post_t mode);
+bool mailbox_get(mailbox_t *m, message_t *msg);
@@ -0,0 +1,21 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// host stand-in for the libavr32 / asf header of the same name
+
+#pragma once
+
+#include "types.h"
+
+#define MONOME_MAX_LED_BYTES 256
+
+extern u8 monomeLedBuffer[MONOME_MAX_LED_BYTES];
+extern u8 monomeFrameDirty;
+extern void (*monome_refresh)(void);
+
+u8 monome_xy_idx(u8 x, u8 y);
+void monome_grid_key_parse_event_data(s32 data, u8 *x, u8 *y, u8 *z);
+void monome_ring_enc_parse_event_data(s32 data, u8 *n, s8 *delta);
@@ -0,0 +1,20 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// host stand-in for the libavr32 / asf header of the same name
+
+#pragma once
+
+#include "types.h"
+
+typedef void(phasor_callback_t)(u8 now, bool reset);
+
+void phasor_set_callback(phasor_callback_t *cb);
+void phasor_setup(u16 hz, u8 divisions);
+void phasor_start(void);
+void phasor_stop(void);
+void phasor_reset(void);
+u16 phasor_set_frequency(u16 hz);
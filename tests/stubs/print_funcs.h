@@ -0,0 +1,13 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// host stand-in for the libavr32 / asf header of the same name
+
+#pragma once
+
+void print_dbg(const char *str);
+void print_dbg_ulong(unsigned long n);
+void print_dbg_hex(unsigned long n);
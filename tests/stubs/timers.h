@@ -0,0 +1,31 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// host stand-in for the libavr32 / asf header of the same name
+
+#pragma once
+
+#include "types.h"
+
+typedef void (*timer_callback_t)(void *caller);
+
+typedef struct _softTimer {
+  u32 ticksRemain;
+  u32 ticks;
+  timer_callback_t callback;
+  void *caller;
+  struct _softTimer *next;
+  struct _softTimer *prev;
+} softTimer_t;
+
+bool timer_add(softTimer_t *t, u32 ticks, timer_callback_t callback, void *caller);
+bool timer_remove(softTimer_t *t);
+void timer_set(softTimer_t *t, u32 ticks);
+void timer_reset(softTimer_t *t);
+void timer_reset_set(softTimer_t *t, u32 ticks);
+void timer_manual(softTimer_t *t);
+void timers_clear(void);
+void process_timers(void);
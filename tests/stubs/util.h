@@ -0,0 +1,19 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// host stand-in for the libavr32 / asf header of the same name
+
+#pragma once
+
+#include <stdlib.h>
+
+#include "types.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+s32 sclip(s32 a, s32 low, s32 high);
+u32 uclip(u32 a, u32 low, u32 high);
@@ -0,0 +1,100 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// arc mode's edge scheduler must produce the same output trace as the per
+// tick process_outputs() it replaced. one long session is run with random
+// knob, front button and encoder input (divisor changes included) and clock
+// input resets, fed to both mode arc and the reference engine, and the
+// outputs compared on every tick.
+
+#include <stdio.h>
+
+// this
+#include "main.h"
+#include "mode_common.h"
+#include "ref_arc.h"
+#include "sim.h"
+
+#define TEST_TICKS 4000000
+#define TEST_INPUT_ODDS 97 // one tick in this many gets some input
+
+static u32 rand_state = 1;
+
+static u32 test_rand(void) {
+  u32 x = rand_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return rand_state = x;
+}
+
+static u8 selection = 0xff;
+static u32 counts[5];
+
+static void random_input(void) {
+  u8 which = test_rand() % 16;
+
+  if (which < 10) {
+    u8 n = test_rand() % 2;
+    s8 delta = (s8)(test_rand() % 31) - 15;
+    sim_ring_enc(n, delta);
+    ref_arc_enc(n, delta);
+    counts[0]++;
+  } else if (which < 12) {
+    u8 p = test_rand() % 8;
+    sim_knob = p << 9;
+    sim_event(kEventPollADC, 0);
+    if (p != selection) {
+      selection = p;
+      ref_arc_knob(p);
+    }
+    counts[1]++;
+  } else if (which < 13) {
+    sim_event(kEventFrontShort, 0);
+    ref_arc_front_short();
+    counts[2]++;
+  } else if (which < 14) {
+    sim_event(kEventFrontLong, 0);
+    ref_arc_front_long();
+    counts[3]++;
+  } else {
+    // the reset is taken by the phasor on its next tick
+    sim_clock_input(1);
+    counts[4]++;
+  }
+}
+
+int main(void) {
+  sim_init();
+  sim_fresh_flash();
+  connected = conARC;
+  init_arc();
+  enter_mode_arc();
+  ref_arc_init();
+
+  // pick up where the knob is before any ticks
+  sim_event(kEventPollADC, 0);
+  selection = 0;
+  ref_arc_knob(0);
+
+  for (u32 i = 0; i < TEST_TICKS; i++) {
+    u8 now = sim_tick();
+    ref_arc_tick(now, sim_reset);
+    if (sim_tr != ref_arc_tr()) {
+      printf("tick %u (phase %u%s) outputs %02x, process_outputs %02x\n", i, now,
+             sim_reset ? " reset" : "", sim_tr, ref_arc_tr());
+      return 1;
+    }
+    if (test_rand() % TEST_INPUT_ODDS == 0) {
+      random_input();
+    }
+  }
+
+  printf("%u ticks match process_outputs (%u enc, %u knob, %u front short, %u front long, "
+         "%u resets)\n",
+         TEST_TICKS, counts[0], counts[1], counts[2], counts[3], counts[4]);
+  return 0;
+}
@@ -0,0 +1,171 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// the app event loop and the event stats it keeps. events are posted to the
+// clock input ring, the timer ring and the shared queue, the handlers take as
+// many cycles as the event data says, and the stats after dispatch_check()
+// are compared with what was posted: calls and cycles per type, how deep the
+// lanes and rings got, and how many posts were dropped.
+
+#include <stdio.h>
+
+// asf
+#include "conf_board.h"
+
+// this
+#include "dispatch.h"
+#include "event_ring.h"
+#include "main.h"
+#include "profile.h"
+#include "sim.h"
+
+#define UI_BUDGET (FMCK_HZ / 1000) // LOW_LANE_BUDGET
+
+static s32 handled[64]; // event data in the order handled
+static u8 handled_count;
+
+static void handler_Work(s32 data) {
+  if (handled_count < sizeof(handled) / sizeof(handled[0])) {
+    handled[handled_count++] = data;
+  }
+  sim_cycles += data;
+}
+
+static void init(void) {
+  sim_init();
+  event_stats_reset();
+  handled_count = 0;
+  app_event_handlers[kEventClockNormal] = &handler_Work;
+  app_event_handlers[kEventClockExt] = &handler_Work;
+  app_event_handlers[kEventKeyTimer] = &handler_Work;
+  app_event_handlers[kEventMonomeRefresh] = &handler_Work;
+  app_event_handlers[kEventMonomeGridKey] = &handler_Work;
+}
+
+static void post(etype type, s32 data) {
+  static event_t e;
+  e.type = type;
+  e.data = data;
+  dispatch_post(&e);
+}
+
+static bool check(const char *test, const char *what, u32 got, u32 want) {
+  if (got != want) {
+    printf("%s: %s %u, expected %u\n", test, what, got, want);
+    return false;
+  }
+  return true;
+}
+
+// one of each source waiting, handled in a single pass
+static bool test_pass(void) {
+  const char *t = "pass";
+  init();
+
+  post(kEventMonomeGridKey, 200);
+  post(kEventMonomeGridKey, 500);
+  post(kEventMonomeGridKey, 300);
+  dispatch_post_timer(kEventKeyTimer, false);
+  dispatch_post_timer(kEventKeyTimer, false);
+  for (u8 i = 0; i < 3; i++) {
+    dispatch_post_timer(kEventMonomeRefresh, true);
+  }
+  dispatch_post_input(kEventClockExt, 50);
+  dispatch_post_input(kEventClockExt, 40);
+  dispatch_post_input(kEventClockNormal, 70);
+
+  dispatch_check();
+
+  profile_t *key = &event_stats.handler[kEventMonomeGridKey];
+  profile_t *ext = &event_stats.handler[kEventClockExt];
+  return check(t, "handled", handled_count, 9) &&
+         // the clock input is a timing event, handled before the queue
+         check(t, "first handled", handled[0], 50) &&
+         check(t, "third handled", handled[2], 70) &&
+         check(t, "clock ext calls", ext->calls, 2) &&
+         check(t, "clock ext max", ext->max, 50) &&
+         check(t, "clock ext min", ext->min, 40) &&
+         check(t, "clock normal calls", event_stats.handler[kEventClockNormal].calls, 1) &&
+         check(t, "grid key calls", key->calls, 3) &&
+         check(t, "grid key max", key->max, 500) &&
+         check(t, "grid key min", key->min, 200) &&
+         check(t, "grid key total", key->total, 1000) &&
+         check(t, "key timer calls", event_stats.handler[kEventKeyTimer].calls, 2) &&
+         // the refreshes coalesce while one is waiting
+         check(t, "refresh calls", event_stats.handler[kEventMonomeRefresh].calls, 1) &&
+         check(t, "depth max", event_stats.depth_max, 9) &&
+         check(t, "input ring max", event_stats.input_depth_max, 3) &&
+         check(t, "timer ring max", event_stats.timer_depth_max, 3) &&
+         check(t, "dropped", event_stats.dropped, 0);
+}
+
+// the rings and the shared queue overflow while the main loop is away
+static bool test_drops(void) {
+  const char *t = "drops";
+  init();
+
+  for (u8 i = 0; i < EVENT_RING_SIZE + 3; i++) {
+    dispatch_post_input(kEventClockExt, 1);
+  }
+  for (u8 i = 0; i < EVENT_RING_SIZE + 2; i++) {
+    dispatch_post_timer(kEventKeyTimer, false);
+  }
+  if (!check(t, "ring drops", event_stats.dropped, 5)) {
+    return false;
+  }
+  // more than the shared queue holds (MAX_EVENTS)
+  for (u8 i = 0; i < 64; i++) {
+    post(kEventMonomeGridKey, 1);
+  }
+  u32 dropped = event_stats.dropped;
+  if (dropped == 5) {
+    printf("%s: no shared queue drops\n", t);
+    return false;
+  }
+
+  for (u8 i = 0; i < 16; i++) {
+    dispatch_check();
+  }
+
+  u32 posted = 2 * EVENT_RING_SIZE + 5 + 64;
+  u32 calls = event_stats.handler[kEventClockExt].calls +
+              event_stats.handler[kEventKeyTimer].calls +
+              event_stats.handler[kEventMonomeGridKey].calls;
+  return check(t, "dropped", event_stats.dropped, dropped) &&
+         check(t, "handled and dropped", calls + dropped, posted) &&
+         check(t, "clock ext calls", event_stats.handler[kEventClockExt].calls, EVENT_RING_SIZE) &&
+         check(t, "key timer calls", event_stats.handler[kEventKeyTimer].calls, EVENT_RING_SIZE) &&
+         check(t, "input ring max", event_stats.input_depth_max, EVENT_RING_SIZE) &&
+         check(t, "timer ring max", event_stats.timer_depth_max, EVENT_RING_SIZE) &&
+         // the timing lane fills first and stops the fill short
+         check(t, "depth max", event_stats.depth_max, LANE_SIZE);
+}
+
+// ui handlers stop for the pass once the budget is spent
+static bool test_budget(void) {
+  const char *t = "budget";
+  init();
+
+  for (u8 i = 0; i < 4; i++) {
+    post(kEventMonomeGridKey, UI_BUDGET / 2 + 1);
+  }
+
+  dispatch_check();
+  if (!check(t, "calls after one pass", event_stats.handler[kEventMonomeGridKey].calls, 2)) {
+    return false;
+  }
+  dispatch_check();
+  return check(t, "calls after two passes", event_stats.handler[kEventMonomeGridKey].calls, 4) &&
+         check(t, "grid key max", event_stats.handler[kEventMonomeGridKey].max, UI_BUDGET / 2 + 1);
+}
+
+int main(void) {
+  if (!test_pass() || !test_drops() || !test_budget()) {
+    return 1;
+  }
+  printf("event stats match what was posted\n");
+  return 0;
+}
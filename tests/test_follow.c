@@ -0,0 +1,133 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// grid mode following an external clock. pulse trains with timing jitter and
+// tempo changes are fed to the clock input, each edge is taken as the
+// interrupt would and handled by the main loop after a random delay. the
+// phase error is how far the phasor is from a step boundary at each pulse, in
+// ticks (PPQ to a step). the later segments clock several steps per pulse,
+// set over ii as II_GRID_CLOCK_STEPS.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// asf
+#include "conf_board.h"
+
+// libavr32
+#include "i2c.h"
+
+// this
+#include "main.h"
+#include "mode_common.h"
+#include "mode_grid.h"
+#include "sim.h"
+
+#define TEST_SEGMENT_PULSES 64
+#define TEST_SETTLE 6     // pulses allowed to converge after a tempo change
+#define TEST_MAX_ERROR 2  // ticks once settled, plus twice the jitter
+#define TEST_LATENCY_MS 8 // longest the main loop takes to get to an edge
+
+typedef struct {
+  u16 bpm;
+  u8 jitter; // pulse timing jitter, +/- percent of the period
+  u8 steps;  // steps per pulse
+} segment_t;
+
+static const segment_t segments[] = {
+    {120, 0, 1}, {120, 2, 1}, {90, 2, 1}, {150, 2, 1}, {150, 5, 1}, {60, 2, 1}, {200, 2, 1},
+    {128, 1, 1}, {120, 0, 2}, {120, 2, 2}, {90, 0, 3}, {90, 0, 4}, {150, 0, 8},
+};
+
+static u32 rand_state = 1;
+
+static u32 test_rand(void) {
+  u32 x = rand_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return rand_state = x;
+}
+
+// uniform in [-range, range]
+static s32 test_spread(u32 range) {
+  return range ? (s32)(test_rand() % (2 * range + 1)) - (s32)range : 0;
+}
+
+int main(void) {
+  sim_init();
+  sim_fresh_flash();
+  init_grid();
+  enter_mode_grid();
+  sim_event(kEventClockNormal, 1);
+
+  u32 time = sim_cycles + FMCK_HZ / 10;
+  u16 last_tick = 0;
+  bool failed = false;
+
+  printf("  bpm  jitter  steps  settled  max error  mean error  steps off\n");
+
+  for (u8 n = 0; n < sizeof(segments) / sizeof(segments[0]); n++) {
+    const segment_t *seg = &segments[n];
+    u8 msg[2] = {II_GRID_CLOCK_STEPS, seg->steps};
+    (*process_ii)(msg, sizeof(msg));
+    // seg->steps per pulse, steps are 16ths
+    u32 period = (u32)FMCK_HZ * 15 * seg->steps / seg->bpm;
+    s32 settled = -1;
+    u32 max_error = 0;
+    u32 sum = 0;
+    u32 count = 0;
+    u32 steps_off = 0;
+    u32 allowed = TEST_MAX_ERROR + 2 * seg->steps * PPQ * seg->jitter / 100;
+
+    for (u32 p = 0; p < TEST_SEGMENT_PULSES; p++) {
+      time += period;
+      u32 edge = time + test_spread(period * seg->jitter / 100);
+      sim_run_until(edge);
+      s32 slot = sim_clock_input(1);
+      u16 tick = clock_edge(slot)->tick;
+
+      // the main loop gets to the edge some time later
+      sim_run_until(edge + test_rand() % (FMCK_HZ / 1000 * TEST_LATENCY_MS));
+      sim_event(kEventClockExt, slot);
+      sim_run_until(edge + FMCK_HZ / 1000 * (TEST_LATENCY_MS + 1));
+      sim_event(kEventClockExt, sim_clock_input(0));
+
+      s16 error = tick % PPQ;
+      if (error >= PPQ / 2) {
+        error -= PPQ;
+      }
+      u16 steps = ((u16)(tick - last_tick) + PPQ / 2) / PPQ;
+      last_tick = tick;
+
+      if (abs(error) > allowed) {
+        settled = -1;
+      } else if (settled < 0) {
+        settled = p;
+      }
+
+      if (p >= TEST_SETTLE) {
+        u32 e = abs(error);
+        max_error = e > max_error ? e : max_error;
+        sum += e;
+        count++;
+        steps_off += steps != seg->steps;
+      }
+    }
+
+    printf("  %3u    %2u%%   %4u    %5d  %9u  %9.2f  %9u\n", seg->bpm, seg->jitter, seg->steps,
+           settled, max_error, (double)sum / count, steps_off);
+    if (settled < 0 || settled > TEST_SETTLE || max_error > allowed || steps_off) {
+      failed = true;
+    }
+  }
+
+  if (failed) {
+    printf("phase error not settled after %u pulses\n", TEST_SETTLE);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,132 @@
+//
+// Copyright (c) 2022 Greg Wuller.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+// reset to first gate latency in grid mode. the only trig is on the first
+// step at phase 0, a reset pulse is sent to the clock input at random times
+// and the time until that trig's output rises is measured. each reset mode is
+// set over ii, which saves it SAVE_DELAY key timer ticks later. the last row
+// takes the tick reset from the main loop instead of the interrupt, after up to
+// TEST_LOOP_MS of other events, as it was before the interrupt path.
+
+#include <stdio.h>
+
+// asf
+#include "conf_board.h"
+
+// libavr32
+#include "i2c.h"
+
+// this
+#include "main.h"
+#include "mode_common.h"
+#include "mode_grid.h"
+#include "sim.h"
+
+#define TEST_RESETS 2000
+#define TEST_LOOP_MS 6 // longest the main loop takes to get to an edge
+
+typedef struct {
+  const char *name;
+  reset_mode_t mode;
+  bool from_loop;
+  u32 steps; // reset is quantized to this many steps
+} reset_test_t;
+
+static const reset_test_t tests[] = {
+    {"tick", resetTick, false, 0},
+    {"step", resetStep, false, 1},
+    {"bar", resetBar, false, GRID_BAR_STEPS},
+    {"tick (main loop)", resetTick, true, 0},
+};
+
+static u32 rand_state = 1;
+
+static u32 test_rand(void) {
+  u32 x = rand_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return rand_state = x;
+}
+
+static double ms(u32 cycles) {
+  return cycles * 1000.0 / FMCK_HZ;
+}
+
+static bool run(const reset_test_t *t) {
+  sim_init();
+  sim_fresh_flash();
+
+  // a single trig on the first step of track 1, at the very start of the step
+  preset_t *preset = sim_grid_preset(0);
+  step_set(&preset->pattern[0].step[0], 0, 1);
+  preset->pattern[0].step[0].voice[0].timing = -MID_PHASE;
+
+  init_grid();
+  enter_mode_grid();
+  u8 msg[2] = {II_GRID_RESET_MODE, t->mode};
+  (*process_ii)(msg, sizeof(msg));
+  // f is const as far as the compiler knows, make sure it is read again
+  volatile nvram_data_t *saved = (volatile nvram_data_t *)&f;
+  if (saved->grid_state.g.reset_mode == t->mode) {
+    printf("%s: reset mode saved before the save delay\n", t->name);
+    return false;
+  }
+  for (u8 i = 0; i < SAVE_DELAY; i++) {
+    keytimer_grid();
+  }
+  if (saved->grid_state.g.reset_mode != t->mode) {
+    printf("%s: reset mode not saved\n", t->name);
+    return false;
+  }
+
+  u32 tick = FMCK_HZ / sim_phasor_hz;
+  u32 step = tick * PPQ;
+  u32 limit = t->steps * step + tick + (t->from_loop ? FMCK_HZ / 1000 * TEST_LOOP_MS : 0);
+  u32 worst = 0;
+  u64 total = 0;
+
+  for (u32 n = 0; n < TEST_RESETS; n++) {
+    // somewhere in the next couple of bars, while the output is low
+    do {
+      sim_run_until(sim_cycles + test_rand() % (2 * GRID_BAR_STEPS * step));
+    } while (sim_tr & 1);
+
+    u32 edge = sim_cycles;
+    if (t->from_loop) {
+      sim_run_until(edge + test_rand() % (FMCK_HZ / 1000 * TEST_LOOP_MS));
+    }
+    sim_event(kEventClockExt, sim_clock_input(1));
+    sim_event(kEventClockExt, sim_clock_input(0));
+
+    while (!(sim_tr & 1)) {
+      sim_tick();
+    }
+    u32 latency = sim_cycles - edge;
+    total += latency;
+    worst = latency > worst ? latency : worst;
+    if (latency > limit) {
+      printf("%s: reset %u took %.2f ms, over %.2f ms\n", t->name, n, ms(latency), ms(limit));
+      return false;
+    }
+  }
+
+  printf("  %-17s %9.2f %9.2f\n", t->name, ms(total / TEST_RESETS), ms(worst));
+  leave_mode_grid();
+  return true;
+}
+
+int main(void) {
+  printf("  reset to gate ms   mean     worst   (tick %.3f ms at %u bpm)\n",
+         ms(FMCK_HZ / ((u32)fix16_to_int(BPM_DEFAULT) * TICKS_PER_BEAT / 60)),
+         fix16_to_int(BPM_DEFAULT));
+  for (u8 i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+    if (!run(&tests[i])) {
+      return 1;
+    }
+  }
+  return 0;
+}